@@ -2,11 +2,46 @@
 
 #include <cstdint>
 
+//////////////////////////////////////////////////////////////
+// Assets are named one of two ways. Assets loaded from disk
+// use a hash of their name or path, with the top bit cleared.
+// Assets made at runtime (`asset_manager_t::create`) get a
+// handle instead: the top bit set, a 7-bit generation and a
+// 24-bit slot index, like `entity_t`. Slots are reused, so a
+// handle to a destroyed asset just stops resolving.
+//////////////////////////////////////////////////////////////
 struct asset_t {
+	static const uint32_t HANDLE_BIT = 1u << 31;
+	static const uint32_t INDEX_BITS = 24;
+	static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+	static const uint32_t GENERATION_MASK = 0x7f;
+
 	uint32_t id;
 
 	asset_t() = default;
-	asset_t(uint32_t id) : id(id) {}
+	asset_t(uint32_t id) : id(id & ~HANDLE_BIT) {}
+
+	inline static asset_t handle(uint32_t idx, uint32_t generation)
+	{
+		asset_t a;
+		a.id = HANDLE_BIT | (generation & GENERATION_MASK) << INDEX_BITS | (idx & INDEX_MASK);
+		return a;
+	}
+
+	inline bool is_handle() const
+	{
+		return (id & HANDLE_BIT) != 0;
+	}
+
+	inline uint32_t index() const
+	{
+		return id & INDEX_MASK;
+	}
+
+	inline uint32_t generation() const
+	{
+		return (id >> INDEX_BITS) & GENERATION_MASK;
+	}
 
 	inline operator uint32_t (void) const
 	{
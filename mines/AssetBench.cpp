@@ -0,0 +1,124 @@
+#include "AssetBench.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "AssetManager.h"
+
+static const uint32_t READ_ASSETS = 1024;
+static const uint32_t WRITER_ASSETS = 20000;
+static const size_t CHURN = 8;
+
+struct bench_blob_t {
+	uint32_t id;
+};
+
+static void writer(asset_manager_t* assets, uint32_t base, std::atomic<bool>* done, size_t* stale)
+{
+	std::vector<uint8_t*> live;
+	asset_t prev = asset_t::handle(0, 0);
+	bool has_prev = false;
+	for (uint32_t i = 0; i < WRITER_ASSETS; i++) {
+		const asset_t asset(base + i);
+		assets->make<bench_blob_t>(asset)->id = asset.id;
+		for (size_t c = 0; c < CHURN; c++)
+			live.push_back(assets->allocate_chunk(asset, 64 + (i * 37 + c * 101) % 4096));
+		for (size_t c = 0; c < CHURN / 2; c++) {
+			assets->free_chunk(asset, live.back());
+			live.pop_back();
+		}
+		live.clear();
+
+		// runtime assets come and go, as chunk meshes would
+		asset_t handle;
+		assets->create<bench_blob_t>(&handle)->id = i;
+		assets->allocate_chunk(handle, 64 + (i * 53) % 4096);
+		if (has_prev) {
+			assets->destroy(prev);
+			if (assets->get(prev) != nullptr)
+				(*stale)++;
+		}
+		prev = handle;
+		has_prev = true;
+	}
+	done->store(true, std::memory_order_release);
+}
+
+int bench_assets(size_t threads)
+{
+	using bench_clock = std::chrono::steady_clock;
+	asset_manager_t assets;
+
+	std::vector<asset_t> handles(READ_ASSETS);
+	for (uint32_t i = 0; i < READ_ASSETS; i++) {
+		assets.make<bench_blob_t>(asset_t(i))->id = i;
+		assets.create<bench_blob_t>(&handles[i])->id = i;
+	}
+
+	std::vector<std::atomic<bool>> done(threads);
+	std::vector<size_t> stale(threads, 0);
+	std::vector<std::thread> pool;
+	const auto start = bench_clock::now();
+	for (size_t t = 0; t < threads; t++) {
+		done[t].store(false);
+		pool.emplace_back(writer, &assets, uint32_t(READ_ASSETS + t * WRITER_ASSETS), &done[t], &stale[t]);
+	}
+
+	// time gets in batches, as a frame's worth of lookups would be
+	size_t reads = 0, batches = 0, bad = 0;
+	double total_ns = 0., max_ns = 0.;
+	for (;;) {
+		bool finished = true;
+		for (auto& d : done)
+			finished = finished && d.load(std::memory_order_acquire);
+
+		const auto t0 = bench_clock::now();
+		for (uint32_t i = 0; i < READ_ASSETS; i++) {
+			bench_blob_t* blob = assets.get<bench_blob_t>(asset_t(i));
+			if (blob == nullptr || blob->id != i)
+				bad++;
+			blob = assets.get<bench_blob_t>(handles[i]);
+			if (blob == nullptr || blob->id != i)
+				bad++;
+		}
+		const double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - t0).count() / (2 * READ_ASSETS);
+		total_ns += ns;
+		if (ns > max_ns)
+			max_ns = ns;
+		reads += 2 * READ_ASSETS;
+		batches++;
+
+		if (finished)
+			break;
+		std::this_thread::yield();
+	}
+	for (auto& t : pool)
+		t.join();
+	for (size_t n : stale)
+		bad += n;
+	const double secs = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+	// everything the writers made must be visible now
+	for (size_t t = 0; t < threads; t++) {
+		for (uint32_t i = 0; i < WRITER_ASSETS; i++) {
+			const uint32_t id = uint32_t(READ_ASSETS + t * WRITER_ASSETS + i);
+			bench_blob_t* blob = assets.get<bench_blob_t>(asset_t(id));
+			if (blob == nullptr || blob->id != id)
+				bad++;
+		}
+	}
+
+	std::printf("[bench] %zu writers, %zu assets made in %.3f s (%.0f/s)\n",
+		threads, threads * WRITER_ASSETS, secs, threads * WRITER_ASSETS / secs);
+	std::printf("[bench] %zu gets: %.1f ns avg, %.1f ns worst batch avg\n",
+		reads, total_ns / batches, max_ns);
+	assets.print();
+	if (bad) {
+		std::printf("[bench] %zu lookups failed!\n", bad);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
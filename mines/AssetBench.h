@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////
+// Contention benchmark for the asset manager (`mines
+// --bench-assets [threads]`): writer threads make named assets,
+// create and destroy runtime ones and churn their chunks while
+// the main thread times `get`, the way the renderer uses it
+// mid-frame. Returns an exit code.
+//////////////////////////////////////////////////////////////
+int bench_assets(size_t threads);
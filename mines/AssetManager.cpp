@@ -1,30 +1,253 @@
 #include "AssetManager.h"
 
+static const size_t INITIAL_SLOTS = 64;
+
+static inline uint32_t mix(uint32_t id)
+{
+	return id * 2654435769u;
+}
+
+// Fibonacci hash of the id: the top bits pick the shard, the rest the slot
+static inline size_t first_slot(uint32_t id, size_t mask)
+{
+	const uint32_t h = mix(id);
+	return (h ^ (h >> 15)) & mask;
+}
+
 asset_manager_t::asset_manager_t()
 {
+	for (shard_t& shard : shards) {
+		shard.table.store(make_table(INITIAL_SLOTS), std::memory_order_relaxed);
+		shard.count = 0;
+	}
+	for (counters_t& c : counters) {
+		c.assets.store(0, std::memory_order_relaxed);
+		c.chunks.store(0, std::memory_order_relaxed);
+		c.bytes.store(0, std::memory_order_relaxed);
+		c.peak.store(0, std::memory_order_relaxed);
+		c.budget = 0;
+	}
+	for (std::atomic<entry_t*>& page : pages)
+		page.store(nullptr, std::memory_order_relaxed);
+	num_slots = 0;
 }
 
 asset_manager_t::~asset_manager_t()
 {
-	for (auto& pair : map) {
-		std::free((void*)pair.second.ptr);
-		release(pair.first);
+	for (shard_t& shard : shards) {
+		table_t* table = shard.table.load(std::memory_order_relaxed);
+		for (size_t i = 0; i <= table->mask; i++) {
+			entry_t& e = table->entries[i];
+			uint8_t* ptr = e.ptr.load(std::memory_order_relaxed);
+			if (ptr == nullptr)
+				continue;
+			release(e.id.load(std::memory_order_relaxed));
+			std::free((void*)ptr);
+		}
+		free_table(table);
+		for (table_t* old : shard.retired)
+			free_table(old);
+	}
+	for (uint32_t i = 0; i < num_slots; i++) {
+		entry_t& e = pages[i >> PAGE_BITS].load(std::memory_order_relaxed)[i & (PAGE_SLOTS - 1)];
+		uint8_t* ptr = e.ptr.load(std::memory_order_relaxed);
+		if (ptr != nullptr) {
+			const uint32_t id = e.id.load(std::memory_order_relaxed);
+			destroy(asset_t::handle(id, id >> asset_t::INDEX_BITS));
+		}
+	}
+	for (std::atomic<entry_t*>& page : pages)
+		delete[] page.load(std::memory_order_relaxed);
+}
+
+asset_manager_t::table_t* asset_manager_t::make_table(size_t slots)
+{
+	table_t* table = new table_t;
+	table->mask = slots - 1;
+	table->entries = new entry_t[slots];
+	for (size_t i = 0; i < slots; i++) {
+		table->entries[i].ptr.store(nullptr, std::memory_order_relaxed);
+		table->entries[i].chunks = nullptr;
+	}
+	return table;
+}
+
+void asset_manager_t::free_table(table_t* table)
+{
+	delete[] table->entries;
+	delete table;
+}
+
+asset_manager_t::shard_t& asset_manager_t::shard_of(uint32_t id)
+{
+	return shards[mix(id) >> 28];
+}
+
+asset_manager_t::entry_t* asset_manager_t::find_locked(shard_t& shard, uint32_t id)
+{
+	if (id & asset_t::HANDLE_BIT) {
+		uint8_t* ptr;
+		return find_handle(id, ptr);
+	}
+	table_t* table = shard.table.load(std::memory_order_relaxed);
+	for (size_t i = first_slot(id, table->mask);; i = (i + 1) & table->mask) {
+		entry_t& e = table->entries[i];
+		if (e.ptr.load(std::memory_order_relaxed) == nullptr)
+			return nullptr;
+		if (e.id.load(std::memory_order_relaxed) == id)
+			return &e;
+	}
+}
+
+asset_manager_t::entry_t* asset_manager_t::find_handle(uint32_t id, uint8_t*& ptr)
+{
+	const uint32_t idx = id & asset_t::INDEX_MASK;
+	entry_t* page = pages[idx >> PAGE_BITS].load(std::memory_order_acquire);
+	if (page == nullptr)
+		return nullptr;
+	entry_t& e = page[idx & (PAGE_SLOTS - 1)];
+	// `id` only changes while `ptr` is null, and is stored before `ptr` is set again: seen
+	// after `ptr`, it is the generation `ptr` was set for (or a later one, which we turn down)
+	ptr = e.ptr.load(std::memory_order_acquire);
+	if (ptr == nullptr || e.id.load(std::memory_order_acquire) != id)
+		return nullptr;
+	return &e;
+}
+
+// copy into a table twice the size and publish it; readers on the old one keep going
+void asset_manager_t::grow(shard_t& shard)
+{
+	table_t* old = shard.table.load(std::memory_order_relaxed);
+	table_t* table = make_table(2 * (old->mask + 1));
+	for (size_t i = 0; i <= old->mask; i++) {
+		const entry_t& e = old->entries[i];
+		uint8_t* ptr = e.ptr.load(std::memory_order_relaxed);
+		if (ptr == nullptr)
+			continue;
+		const uint32_t id = e.id.load(std::memory_order_relaxed);
+		size_t j = first_slot(id, table->mask);
+		while (table->entries[j].ptr.load(std::memory_order_relaxed) != nullptr)
+			j = (j + 1) & table->mask;
+		entry_t& dst = table->entries[j];
+		dst.id.store(id, std::memory_order_relaxed);
+		dst.category = e.category;
+		dst.sz = e.sz;
+		dst.chunks = e.chunks;
+		dst.ptr.store(ptr, std::memory_order_relaxed);
+	}
+	shard.table.store(table, std::memory_order_release);
+	shard.retired.push_back(old);
+}
+
+void asset_manager_t::add_bytes(uint8_t category, size_t bytes)
+{
+	counters_t& c = counters[category];
+	const size_t now = c.bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	size_t peak = c.peak.load(std::memory_order_relaxed);
+	while (now > peak && !c.peak.compare_exchange_weak(peak, now, std::memory_order_relaxed))
+		;
+}
+
+void asset_manager_t::sub_bytes(uint8_t category, size_t bytes)
+{
+	counters[category].bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void asset_manager_t::load(const asset_t asset, uint8_t* data, size_t sz, category_t category)
+{
+	assert(!asset.is_handle());
+	shard_t& shard = shard_of(asset.id);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	assert(find_locked(shard, asset.id) == nullptr);
+	if (2 * (shard.count + 1) > shard.table.load(std::memory_order_relaxed)->mask + 1)
+		grow(shard);
+
+	table_t* table = shard.table.load(std::memory_order_relaxed);
+	size_t i = first_slot(asset.id, table->mask);
+	while (table->entries[i].ptr.load(std::memory_order_relaxed) != nullptr)
+		i = (i + 1) & table->mask;
+	entry_t& e = table->entries[i];
+	e.id.store(asset.id, std::memory_order_relaxed);
+	e.category = static_cast<uint8_t>(category);
+	e.sz = sz;
+	e.chunks = nullptr;
+	e.ptr.store(data, std::memory_order_release);
+	shard.count++;
+	counters[category].assets.fetch_add(1, std::memory_order_relaxed);
+	add_bytes(category, sz);
+}
+
+// slots are reused oldest first (as entities are), so a generation takes long to come around
+asset_t asset_manager_t::load_handle(uint8_t* data, size_t sz, category_t category)
+{
+	std::lock_guard<std::mutex> lock(handle_mtx);
+	uint32_t idx;
+	if (!free_slots.empty()) {
+		idx = free_slots.front();
+		free_slots.pop_front();
+	} else {
+		idx = num_slots++;
+		assert(idx <= asset_t::INDEX_MASK);
+		if ((idx & (PAGE_SLOTS - 1)) == 0) {
+			entry_t* page = new entry_t[PAGE_SLOTS];
+			for (uint32_t i = 0; i < PAGE_SLOTS; i++) {
+				page[i].ptr.store(nullptr, std::memory_order_relaxed);
+				page[i].id.store(asset_t::handle(idx + i, 0).id, std::memory_order_relaxed);
+				page[i].chunks = nullptr;
+			}
+			pages[idx >> PAGE_BITS].store(page, std::memory_order_release);
+		}
 	}
+
+	entry_t& e = pages[idx >> PAGE_BITS].load(std::memory_order_relaxed)[idx & (PAGE_SLOTS - 1)];
+	e.category = static_cast<uint8_t>(category);
+	e.sz = sz;
+	e.chunks = nullptr;
+	e.ptr.store(data, std::memory_order_release);
+	counters[category].assets.fetch_add(1, std::memory_order_relaxed);
+	add_bytes(category, sz);
+	asset_t asset;
+	asset.id = e.id.load(std::memory_order_relaxed);
+	return asset;
 }
 
-void asset_manager_t::load(const asset_t asset, uint8_t* data, size_t sz)
+void asset_manager_t::destroy(const asset_t asset)
 {
-	map.insert(std::pair<asset_t, sized_ptr_t>(asset, { data, sz }));
-	chunks.insert({ asset, {} });
+	assert(asset.is_handle());
+	release(asset);
+
+	std::lock_guard<std::mutex> lock(handle_mtx);
+	uint8_t* ptr;
+	entry_t* e = find_handle(asset.id, ptr);
+	assert(e != nullptr);
+	e->ptr.store(nullptr, std::memory_order_release);
+	e->id.store(asset_t::handle(asset.index(), asset.generation() + 1).id, std::memory_order_relaxed);
+	counters[e->category].assets.fetch_sub(1, std::memory_order_relaxed);
+	sub_bytes(e->category, e->sz);
+	std::free((void*)ptr);
+	free_slots.push_back(asset.index());
 }
 
 void asset_manager_t::release(const asset_t asset)
 {
-	auto it = chunks.find(asset);
-	assert(it != chunks.end());
-	for (auto chunk : it->second)
-		delete[] chunk.ptr;
-	it->second.clear();
+	shard_t& shard = shard_of(asset.id);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	entry_t* e = find_locked(shard, asset.id);
+	assert(e != nullptr);
+	pool_allocator_t::header_t* h = e->chunks;
+	size_t chunk_ct = 0;
+	size_t total_sz = 0;
+	while (h) {
+		pool_allocator_t::header_t* next = h->next;
+		uint8_t* ptr = reinterpret_cast<uint8_t*>(h + 1);
+		chunk_ct++;
+		total_sz += pool_allocator_t::capacity(ptr);
+		shard.pool.free(ptr);
+		h = next;
+	}
+	e->chunks = nullptr;
+	counters[e->category].chunks.fetch_sub(chunk_ct, std::memory_order_relaxed);
+	sub_bytes(e->category, total_sz);
 }
 
 static const char* units[] = { "bytes", "kB", "MB", "GB" };
@@ -40,70 +263,136 @@ static std::pair<float, unsigned int> sz_to_human(float sz)
 
 void asset_manager_t::free_chunk(const asset_t asset, uint8_t* ptr)
 {
-	auto it = chunks.find(asset);
-	if (it == chunks.end())
+	if (ptr == nullptr)
 		return;
-	int idx = -1;
-	int i = 0;
-	for (auto &sp : it->second) {
-		if (sp.ptr == ptr) {
-			delete[] ptr;
-			idx = i;
-			break;
-		}
-		i++;
+	shard_t& shard = shard_of(asset.id);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	entry_t* e = find_locked(shard, asset.id);
+	assert(e != nullptr);
+	pool_allocator_t::header_t* h = pool_allocator_t::header(ptr);
+	assert(h->owner == asset.id);
+	if (h->next)
+		h->next->prev = h->prev;
+	if (h->prev) {
+		h->prev->next = h->next;
+	} else {
+		assert(e->chunks == h);
+		e->chunks = h->next;
 	}
-	if (idx != -1)
-		it->second.erase(it->second.begin() + idx);
+	counters[e->category].chunks.fetch_sub(1, std::memory_order_relaxed);
+	sub_bytes(e->category, pool_allocator_t::capacity(ptr));
+	shard.pool.free(ptr);
 }
 
 size_t asset_manager_t::get_chunk_size(const asset_t asset, uint8_t* ptr)
 {
-	auto it = chunks.find(asset);
-	if (it == chunks.end())
+	if (ptr == nullptr)
 		return 0;
-	for (auto chunk : it->second) {
-		if (chunk.ptr == ptr)
-			return chunk.sz;
+	assert(pool_allocator_t::header(ptr)->owner == asset.id);
+	return pool_allocator_t::capacity(ptr);
+}
+
+asset_manager_t::usage_t asset_manager_t::usage(category_t category) const
+{
+	const counters_t& c = counters[category];
+	usage_t u;
+	u.assets = c.assets.load(std::memory_order_relaxed);
+	u.chunks = c.chunks.load(std::memory_order_relaxed);
+	u.bytes = c.bytes.load(std::memory_order_relaxed);
+	u.peak = c.peak.load(std::memory_order_relaxed);
+	return u;
+}
+
+void asset_manager_t::set_budget(category_t category, size_t bytes, budget_fn on_over)
+{
+	counters[category].budget = bytes;
+	counters[category].on_over = on_over;
+}
+
+// freed chunks kept in the pools are memory the process still holds, so they count
+// against every budget; a budget they push over has them given back first
+void asset_manager_t::check_budgets()
+{
+	size_t idle = 0;
+	for (shard_t& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		idle += shard.pool.free_bytes();
+	}
+	for (counters_t& c : counters) {
+		if (c.budget == 0 || !c.on_over)
+			continue;
+		const size_t bytes = c.bytes.load(std::memory_order_relaxed);
+		if (bytes + idle > c.budget && idle > 0) {
+			for (shard_t& shard : shards) {
+				std::lock_guard<std::mutex> lock(shard.mtx);
+				shard.pool.trim();
+			}
+			idle = 0;
+		}
+		if (bytes > c.budget)
+			c.on_over(bytes - c.budget);
 	}
-	return 0;
 }
 
+static const char* category_names[] = { "misc", "chunk meshes", "models" };
+
 void asset_manager_t::print()
 {
 	size_t sum = 0;
-	for (auto& p : map) {
-		//std::printf("[assets] inspecting %u (%zu byte plain asset)\n", p.first.id, p.second.sz);
-		auto it = chunks.find(p.first);
-		size_t chunk_ct = 0;
-		size_t total_sz = 0;
-		if (it != chunks.end()) {
-			for (auto& chunk : it->second) {
-				chunk_ct++;
-				total_sz += chunk.sz;
-			}
-		}
-		auto res = sz_to_human(total_sz);
-		//std::printf("[assets]    has %zu chunks, total %.2f %s\n", chunk_ct, res.first, units[res.second]);
-		sum += total_sz;
+	for (int i = 0; i < _COUNT; i++) {
+		const usage_t u = usage(static_cast<category_t>(i));
+		if (u.peak == 0)
+			continue;
+		auto res = sz_to_human(static_cast<float>(u.bytes));
+		auto peak = sz_to_human(static_cast<float>(u.peak));
+		std::printf("[assets] %s: %zu assets, %zu chunks, %.2f %s (peak %.2f %s)\n", category_names[i],
+			u.assets, u.chunks, res.first, units[res.second], peak.first, units[peak.second]);
+		sum += u.bytes;
 	}
-	auto res = sz_to_human(sum);
+	auto res = sz_to_human(static_cast<float>(sum));
 	std::printf("[assets] total asset data: %.2f %s\n", res.first, units[res.second]);
+
+	size_t live = 0;
+	size_t idle = 0;
+	for (shard_t& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		live += shard.pool.live_blocks();
+		idle += shard.pool.free_bytes();
+	}
+	res = sz_to_human(static_cast<float>(idle));
+	std::printf("[assets] chunk pool: %zu live chunks, %.2f %s free\n", live, res.first, units[res.second]);
 }
 
 uint8_t* asset_manager_t::allocate_chunk(const asset_t asset, const size_t sz)
 {
-	auto it = chunks.find(asset);
-	assert(it != chunks.end());
-	uint8_t *chunk = new uint8_t[sz];
-	it->second.push_back({ chunk, sz });
+	shard_t& shard = shard_of(asset.id);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	entry_t* e = find_locked(shard, asset.id);
+	assert(e != nullptr);
+	uint8_t *chunk = shard.pool.allocate(sz, asset.id);
+	pool_allocator_t::header_t* h = pool_allocator_t::header(chunk);
+	h->next = e->chunks;
+	if (e->chunks)
+		e->chunks->prev = h;
+	e->chunks = h;
+	counters[e->category].chunks.fetch_add(1, std::memory_order_relaxed);
+	add_bytes(e->category, pool_allocator_t::capacity(chunk));
 	return chunk;
 }
 
 uint8_t* asset_manager_t::get(const asset_t asset)
 {
-	auto it = map.find(asset);
-	if (it == map.end())
-		return nullptr;
-	return it->second.ptr;
+	if (asset.is_handle()) {
+		uint8_t* ptr;
+		return find_handle(asset.id, ptr) ? ptr : nullptr;
+	}
+	const table_t* table = shard_of(asset.id).table.load(std::memory_order_acquire);
+	for (size_t i = first_slot(asset.id, table->mask);; i = (i + 1) & table->mask) {
+		const entry_t& e = table->entries[i];
+		uint8_t* ptr = e.ptr.load(std::memory_order_acquire);
+		if (ptr == nullptr)
+			return nullptr;
+		if (e.id.load(std::memory_order_acquire) == asset.id)
+			return ptr;
+	}
 }
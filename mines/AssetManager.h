@@ -1,24 +1,76 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
-#include <unordered_map>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
 #include "PackedArray.h"
 #include "Asset.h"
+#include "PoolAllocator.h"
 
+//////////////////////////////////////////////////////////////
+// Assets and their data chunks, safe to use from any thread.
+// Assets are split over shards by id; each shard has its own
+// lock (and chunk pool) for writers, and an open-addressing
+// table that `get` reads without locking. Tables only ever
+// grow: a full one is copied and the old copy is kept until
+// shutdown, so a reader still on it sees valid (if slightly
+// stale) entries. Asset contents are not synchronized; that
+// is up to whoever shares them.
+// Every asset belongs to a category, which keeps live counts
+// of its assets, chunks and bytes and may have a budget; the
+// handler of a category over budget is called from
+// `check_budgets`, never from inside an allocation. Chunks
+// freed into the pools count against budgets until trimmed.
+// Assets made at runtime live in a slot array instead, paged
+// so that slots never move, and are named by handle (see
+// `asset_t`); `get` on those is one array lookup.
+//////////////////////////////////////////////////////////////
 class asset_manager_t
 {
 public:
+	enum category_t {
+		MISC,
+		CHUNK_MESHES,
+		MODELS,
+		_COUNT
+	};
+	struct usage_t {
+		size_t assets;
+		size_t chunks;
+		// asset structs plus the usable bytes of their chunks
+		size_t bytes;
+		// most `bytes` held at once so far
+		size_t peak;
+	};
+	// gets how many bytes the category is over its budget
+	typedef std::function<void(size_t over)> budget_fn;
+
 	asset_manager_t();
 	~asset_manager_t();
 
 	template<typename T>
-	T* make(const asset_t asset)
+	T* make(const asset_t asset, category_t category = MISC)
+	{
+		assert(get(asset) == nullptr);
+		T* t = (T*)std::malloc(sizeof(T));
+		load(asset, (uint8_t*)t, sizeof(T), category);
+		return t;
+	}
+
+	// runtime asset, named by a new handle
+	template<typename T>
+	T* create(asset_t* asset, category_t category = MISC)
 	{
-		assert(map.find(asset) == map.end());
 		T* t = (T*)std::malloc(sizeof(T));
-		load(asset, (uint8_t*)t, sizeof(T));
+		*asset = load_handle((uint8_t*)t, sizeof(T), category);
 		return t;
 	}
+	// frees a created asset and its chunks; its handle goes stale
+	void destroy(const asset_t asset);
 
 	void release(const asset_t asset);
 	uint8_t* allocate_chunk(const asset_t asset, const size_t sz);
@@ -28,6 +80,7 @@ public:
 	{
 		return (T*)allocate_chunk(asset, count * sizeof(T));
 	}
+	// wait-free
 	uint8_t* get(const asset_t asset);
 
 	void free_chunk(const asset_t asset, uint8_t* ptr);
@@ -38,17 +91,74 @@ public:
 		return (T*)get(asset);
 	}
 
+	// usable bytes of a chunk (at least what was asked for), 0 for null
 	size_t get_chunk_size(const asset_t asset, uint8_t* ptr);
 
+	usage_t usage(category_t category) const;
+	// 0 bytes: no budget. not thread-safe, set up budgets before loading
+	void set_budget(category_t category, size_t bytes, budget_fn on_over);
+	// calls the handlers of the categories over budget, on this thread
+	void check_budgets();
+
 	void print();
 private:
-	void load(const asset_t asset, uint8_t* data, size_t sz);
+	void load(const asset_t asset, uint8_t* data, size_t sz, category_t category);
+	asset_t load_handle(uint8_t* data, size_t sz, category_t category);
 
-	struct sized_ptr_t {
-		uint8_t* ptr;
+	struct entry_t {
+		// null while the slot is empty; set last, once `id` and `sz` are in place
+		std::atomic<uint8_t*> ptr;
+		// atomic as readers check it without a lock; handle slots change it on reuse
+		std::atomic<uint32_t> id;
+		uint8_t category;
 		size_t sz;
+		// first of the asset's chunks, linked through their pool headers (writers only)
+		pool_allocator_t::header_t* chunks;
 	};
-	std::unordered_map<asset_t, sized_ptr_t, asset_hash_f> map;
-	std::unordered_map<asset_t, std::vector<sized_ptr_t>, asset_hash_f> chunks;
-};
+	struct table_t {
+		// at most half full, so probes always end on an empty slot
+		size_t mask;
+		entry_t* entries;
+	};
+	struct shard_t {
+		std::mutex mtx;
+		std::atomic<table_t*> table;
+		size_t count;
+		// replaced tables, which readers may still be probing
+		std::vector<table_t*> retired;
+		pool_allocator_t pool;
+	};
+	static const size_t NUM_SHARDS = 16;
+	static const uint32_t PAGE_BITS = 12;
+	static const uint32_t PAGE_SLOTS = 1u << PAGE_BITS;
+	static const uint32_t MAX_PAGES = (asset_t::INDEX_MASK + 1) >> PAGE_BITS;
+	struct counters_t {
+		std::atomic<size_t> assets;
+		std::atomic<size_t> chunks;
+		std::atomic<size_t> bytes;
+		std::atomic<size_t> peak;
+		size_t budget;
+		budget_fn on_over;
+	};
+
+	static table_t* make_table(size_t slots);
+	static void free_table(table_t* table);
+	shard_t& shard_of(uint32_t id);
+	// slot of `id` in the shard's current table (or its handle slot); the shard must be locked
+	entry_t* find_locked(shard_t& shard, uint32_t id);
+	// slot of a handle and the data it held when `id` was checked, null if it is stale
+	entry_t* find_handle(uint32_t id, uint8_t*& ptr);
+	void grow(shard_t& shard);
+	void add_bytes(uint8_t category, size_t bytes);
+	void sub_bytes(uint8_t category, size_t bytes);
 
+	shard_t shards[NUM_SHARDS];
+	counters_t counters[_COUNT];
+
+	// handle slots; a slot's `id` is its next handle while it is free. writers take
+	// `handle_mtx` to take or return slots, and the shard lock of the handle for chunks
+	std::mutex handle_mtx;
+	std::atomic<entry_t*> pages[MAX_PAGES];
+	uint32_t num_slots;
+	std::deque<uint32_t> free_slots;
+};
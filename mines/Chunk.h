@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Entity.h"
+#include "Asset.h"
+#include "ChunkVolume.h"
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec3.hpp>
+
+// "no chunk" slot index, see chunk_map_t
+inline const uint32_t NO_CHUNK = ~0u;
+
+struct chunk_t {
+	enum {
+		GRASS = 0,
+		ROCK,
+		WATER,
+		_COUNT,
+		AIR,
+	};
+	entity_t entity;
+	asset_t meshes[_COUNT];
+	// blocks of the loaded chunk, kept so it can be remeshed or edited without regenerating
+	chunk_volume_t volume;
+	// 8x8x8 bricks of `volume` that may hold anything but AIR, see chunk_volume_t::occupancy.
+	// only ever too large (after edits), so empty bricks can be skipped by raycasts
+	uint64_t bricks[8];
+
+	// id of the last load request issued for this chunk; results
+	// carrying an older ticket belong to a previous occupant and are dropped
+	uint32_t ticket;
+	// true once the meshes for `ticket` have been copied into the assets
+	bool loaded;
+	// true while a job for `ticket` is queued or running
+	bool queued;
+	// level of detail and seams of the meshes built or being built, see chunk_job_t
+	uint8_t lod;
+	uint8_t seams;
+	// materials whose meshes are out of date after `map_system_t::set_block`
+	uint8_t dirty;
+	// true once a RenderModel has been submitted for `entity`
+	bool has_model;
+	// requested ahead of the camera and not come into view yet
+	bool prefetched;
+	// blocks were changed by `map_system_t::set_block`, so they no longer match the generated
+	// (or stored) ones: saved to the store before the chunk is recycled, or never recycled without one.
+	// also set on neighbours of an edit across a border, whose stored meshes are out of date
+	bool edited;
+
+	// residency bookkeeping, see chunk_residency_t
+	glm::ivec3 coord;
+	uint32_t lru_prev;
+	uint32_t lru_next;
+	size_t bytes;
+};
+
+// chunk coordinate and position inside it of a world block position
+inline glm::ivec3 split_block_pos(const glm::ivec3& pos, glm::ivec3& local)
+{
+	auto wrap = [](int v) { return ((v % CHUNK_SIZE) + CHUNK_SIZE) % CHUNK_SIZE; };
+	local = glm::ivec3(wrap(pos.x), wrap(pos.y), wrap(pos.z));
+	return (pos - local) / CHUNK_SIZE;
+}
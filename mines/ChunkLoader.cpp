@@ -0,0 +1,139 @@
+#include "ChunkLoader.h"
+#include <algorithm>
+#include <cassert>
+#include <Tracy.hpp>
+
+chunk_loader_t::chunk_loader_t()
+	: quit(false), queued_prefetch(0)
+{
+}
+
+chunk_loader_t::~chunk_loader_t()
+{
+	stop();
+}
+
+void chunk_loader_t::start(size_t num_workers, work_fn fn)
+{
+	assert(workers.empty());
+	work = fn;
+	quit = false;
+	for (size_t i = 0; i < num_workers; i++)
+		workers.emplace_back(&chunk_loader_t::run, this, i);
+}
+
+void chunk_loader_t::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_mtx);
+		quit = true;
+		jobs.clear();
+		queued_prefetch = 0;
+	}
+	jobs_cv.notify_all();
+	for (auto& t : workers)
+		t.join();
+	workers.clear();
+}
+
+bool chunk_loader_t::later(const chunk_job_t& a, const chunk_job_t& b)
+{
+	if (a.prefetch != b.prefetch)
+		return a.prefetch;
+	return a.priority > b.priority;
+}
+
+void chunk_loader_t::push(const chunk_job_t& job)
+{
+	{
+		std::lock_guard<std::mutex> lock(jobs_mtx);
+		jobs.push_back(job);
+		std::push_heap(jobs.begin(), jobs.end(), later);
+		if (job.prefetch)
+			queued_prefetch++;
+	}
+	jobs_cv.notify_one();
+}
+
+size_t chunk_loader_t::drain(std::vector<chunk_result_t>& out, size_t budget)
+{
+	std::lock_guard<std::mutex> lock(done_mtx);
+	size_t ct = 0;
+	while (ct < budget && !done.empty()) {
+		out.push_back(std::move(done.front()));
+		done.pop_front();
+		ct++;
+	}
+	return ct;
+}
+
+bool chunk_loader_t::promote(uint32_t ticket, float priority)
+{
+	std::lock_guard<std::mutex> lock(jobs_mtx);
+	for (chunk_job_t& job : jobs) {
+		if (job.ticket == ticket && job.prefetch) {
+			job.prefetch = false;
+			job.priority = priority;
+			queued_prefetch--;
+			std::make_heap(jobs.begin(), jobs.end(), later);
+			return true;
+		}
+	}
+	return false;
+}
+
+void chunk_loader_t::reprioritize(const priority_fn& fn, std::vector<chunk_job_t>& cancelled)
+{
+	std::lock_guard<std::mutex> lock(jobs_mtx);
+	size_t kept = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		chunk_job_t job = jobs[i];
+		job.priority = fn(job);
+		if (job.priority < 0.f) {
+			if (job.prefetch)
+				queued_prefetch--;
+			cancelled.push_back(job);
+			continue;
+		}
+		jobs[kept++] = job;
+	}
+	jobs.resize(kept);
+	std::make_heap(jobs.begin(), jobs.end(), later);
+}
+
+size_t chunk_loader_t::prefetching()
+{
+	std::lock_guard<std::mutex> lock(jobs_mtx);
+	return queued_prefetch;
+}
+
+void chunk_loader_t::run(size_t worker)
+{
+	for (;;) {
+		chunk_job_t job;
+		{
+			std::unique_lock<std::mutex> lock(jobs_mtx);
+			jobs_cv.wait(lock, [this] { return quit || !jobs.empty(); });
+			if (quit)
+				return;
+			std::pop_heap(jobs.begin(), jobs.end(), later);
+			job = jobs.back();
+			jobs.pop_back();
+			if (job.prefetch)
+				queued_prefetch--;
+		}
+
+		chunk_result_t result;
+		result.coord = job.coord;
+		result.ticket = job.ticket;
+		result.lod = job.lod;
+		result.seams = job.seams;
+		result.remeshed = job.source != nullptr;
+		work(worker, job, result);
+
+		{
+			std::lock_guard<std::mutex> lock(done_mtx);
+			done.push_back(std::move(result));
+		}
+	}
+}
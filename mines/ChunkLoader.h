@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <glm/vec3.hpp>
+#include "Chunk.h"
+#include "IndexedMesh.h"
+#include "Mesher.h"
+
+struct chunk_job_t {
+	glm::ivec3 coord;
+	uint32_t ticket;
+	// lower runs sooner
+	float priority;
+	// prefetch jobs only run when no regular job is waiting
+	bool prefetch;
+	// mesh at 1 << lod blocks per cell; `seams` has a bit per direction whose
+	// neighbour is at another level, so the faces towards it are kept
+	uint8_t lod;
+	uint8_t seams;
+	// if set, just remesh these blocks instead of generating the chunk
+	std::shared_ptr<const chunk_volume_t> source;
+	// neighbour blocks to mesh against instead of the generated terrain, for the
+	// directions in `border_dirs` (neighbours that were loaded, and may have edits)
+	std::shared_ptr<const chunk_border_t> border;
+	uint8_t border_dirs;
+};
+
+struct chunk_result_t {
+	glm::ivec3 coord;
+	uint32_t ticket;
+	uint8_t lod;
+	uint8_t seams;
+	// true if only the meshes were rebuilt; `volume` is left empty
+	bool remeshed;
+	chunk_volume_t volume;
+	std::vector<IndexedMesh::Vertex> vertices[chunk_t::_COUNT];
+	// raw indices, see IndexedMesh::index_size; empty for face meshes
+	std::vector<uint8_t> indices[chunk_t::_COUNT];
+};
+
+//////////////////////////////////////////////////////////////
+// Persistent pool of background workers that turn chunk jobs
+// into finished meshes. The main thread pushes jobs and drains
+// results; workers never touch the asset or entity managers.
+// Queued jobs run in priority order and can be re-prioritized
+// or cancelled until a worker picks them up.
+//////////////////////////////////////////////////////////////
+class chunk_loader_t {
+public:
+	typedef std::function<void(size_t worker, const chunk_job_t& job, chunk_result_t& out)> work_fn;
+	// new priority for a queued job; negative cancels it
+	typedef std::function<float(const chunk_job_t& job)> priority_fn;
+
+	chunk_loader_t();
+	~chunk_loader_t();
+
+	void start(size_t num_workers, work_fn fn);
+	void stop();
+
+	void push(const chunk_job_t& job);
+	// turn a queued prefetch job into a regular one; false if it isn't queued
+	bool promote(uint32_t ticket, float priority);
+	// recompute the priority of every queued job, moving cancelled ones to `cancelled`
+	void reprioritize(const priority_fn& fn, std::vector<chunk_job_t>& cancelled);
+	// move at most `budget` finished results into `out`
+	size_t drain(std::vector<chunk_result_t>& out, size_t budget);
+
+	// prefetch jobs still waiting for a worker
+	size_t prefetching();
+
+private:
+	void run(size_t worker);
+	// heap order: true if `a` should run after `b`
+	static bool later(const chunk_job_t& a, const chunk_job_t& b);
+
+	work_fn work;
+	std::vector<std::thread> workers;
+	bool quit;
+
+	std::mutex jobs_mtx;
+	std::condition_variable jobs_cv;
+	// binary heap, see `later`
+	std::vector<chunk_job_t> jobs;
+	size_t queued_prefetch;
+
+	std::mutex done_mtx;
+	std::deque<chunk_result_t> done;
+};
@@ -0,0 +1,100 @@
+#include "ChunkMap.h"
+#include <cassert>
+
+static const size_t INITIAL_BUCKETS = 1024;
+
+// spread the low 21 bits of `v` so there are two zero bits between each
+static uint64_t spread3(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+static uint64_t morton3(const glm::ivec3& c)
+{
+	// bias so small negative coordinates don't all land on the high bits
+	const uint64_t bias = 1u << 20;
+	return spread3(c.x + bias) | spread3(c.y + bias) << 1 | spread3(c.z + bias) << 2;
+}
+
+chunk_map_t::chunk_map_t()
+	: table(INITIAL_BUCKETS, NO_CHUNK), mask(INITIAL_BUCKETS - 1)
+{
+}
+
+size_t chunk_map_t::bucket(const glm::ivec3& coord) const
+{
+	// the morton code packs all three axes into one key without favouring any of
+	// them; fibonacci hashing then spreads a dense cube of keys over the whole table
+	// so linear probing doesn't pile up into long runs
+	return static_cast<size_t>((morton3(coord) * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+}
+
+uint32_t chunk_map_t::find(const glm::ivec3& coord) const
+{
+	for (size_t b = bucket(coord); ; b = (b + 1) & mask) {
+		const uint32_t slot = table[b];
+		if (slot == NO_CHUNK || chunks[slot].coord == coord)
+			return slot;
+	}
+}
+
+void chunk_map_t::place(uint32_t slot)
+{
+	size_t b = bucket(chunks[slot].coord);
+	while (table[b] != NO_CHUNK)
+		b = (b + 1) & mask;
+	table[b] = slot;
+}
+
+void chunk_map_t::grow()
+{
+	table.assign(table.size() * 2, NO_CHUNK);
+	mask = table.size() - 1;
+	for (uint32_t slot = 0; slot < chunks.size(); slot++)
+		place(slot);
+}
+
+uint32_t chunk_map_t::insert(const chunk_t& chunk)
+{
+	assert(find(chunk.coord) == NO_CHUNK);
+	// keep the load factor under 1/2 so probe runs stay short
+	if ((chunks.size() + 1) * 2 > table.size())
+		grow();
+	const uint32_t slot = static_cast<uint32_t>(chunks.size());
+	chunks.push_back(chunk);
+	place(slot);
+	return slot;
+}
+
+// backward-shift deletion: no tombstones, so lookups never degrade over time
+void chunk_map_t::erase(const glm::ivec3& coord)
+{
+	size_t hole = bucket(coord);
+	while (chunks[table[hole]].coord != coord)
+		hole = (hole + 1) & mask;
+
+	for (size_t b = (hole + 1) & mask; table[b] != NO_CHUNK; b = (b + 1) & mask) {
+		// move entries whose home bucket isn't in (hole, b] back into the hole
+		const size_t home = bucket(chunks[table[b]].coord);
+		const bool stays = hole <= b ? (hole < home && home <= b) : (hole < home || home <= b);
+		if (!stays) {
+			table[hole] = table[b];
+			hole = b;
+		}
+	}
+	table[hole] = NO_CHUNK;
+}
+
+void chunk_map_t::rekey(uint32_t slot, const glm::ivec3& coord)
+{
+	assert(find(coord) == NO_CHUNK);
+	erase(chunks[slot].coord);
+	chunks[slot].coord = coord;
+	place(slot);
+}
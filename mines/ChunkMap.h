@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "Chunk.h"
+
+//////////////////////////////////////////////////////////////
+// Chunks by coordinate. The chunks themselves live in one
+// contiguous vector and are addressed by slot index; lookups go
+// through a flat open-addressing (linear probing) table of slot
+// indices, hashed from the Morton code of the coordinate. Slots
+// are never freed, only re-keyed when a chunk is recycled for
+// another coordinate, so iteration is a plain array walk.
+//////////////////////////////////////////////////////////////
+class chunk_map_t {
+public:
+	chunk_map_t();
+
+	// slot of the chunk at `coord`, or NO_CHUNK
+	uint32_t find(const glm::ivec3& coord) const;
+	// add `chunk` (keyed by `chunk.coord`, which must be new) and return its slot
+	uint32_t insert(const chunk_t& chunk);
+	// move the chunk in `slot` to `coord`, which must be free
+	void rekey(uint32_t slot, const glm::ivec3& coord);
+
+	inline chunk_t& operator[](uint32_t slot) { return chunks[slot]; }
+	inline const chunk_t& operator[](uint32_t slot) const { return chunks[slot]; }
+	inline size_t size() const { return chunks.size(); }
+
+	inline std::vector<chunk_t>::iterator begin() { return chunks.begin(); }
+	inline std::vector<chunk_t>::iterator end() { return chunks.end(); }
+
+private:
+	size_t bucket(const glm::ivec3& coord) const;
+	void place(uint32_t slot);
+	void erase(const glm::ivec3& coord);
+	void grow();
+
+	std::vector<chunk_t> chunks;
+	// slot per bucket, NO_CHUNK if empty
+	std::vector<uint32_t> table;
+	size_t mask;
+};
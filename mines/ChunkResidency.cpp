@@ -0,0 +1,97 @@
+#include "ChunkResidency.h"
+#include <cassert>
+#include <cstdlib>
+#include <algorithm>
+
+chunk_residency_t::chunk_residency_t(chunk_map_t& chunks)
+	: chunks(chunks), head(NO_CHUNK), tail(NO_CHUNK), n(0), total(0), limit(0), pinned(false)
+{
+}
+
+void chunk_residency_t::set_budget(size_t bytes)
+{
+	limit = bytes;
+}
+
+void chunk_residency_t::unlink(uint32_t slot)
+{
+	chunk_t& chunk = chunks[slot];
+	if (chunk.lru_prev != NO_CHUNK)
+		chunks[chunk.lru_prev].lru_next = chunk.lru_next;
+	else
+		head = chunk.lru_next;
+	if (chunk.lru_next != NO_CHUNK)
+		chunks[chunk.lru_next].lru_prev = chunk.lru_prev;
+	else
+		tail = chunk.lru_prev;
+	chunk.lru_prev = chunk.lru_next = NO_CHUNK;
+}
+
+void chunk_residency_t::push_front(uint32_t slot)
+{
+	chunk_t& chunk = chunks[slot];
+	chunk.lru_prev = NO_CHUNK;
+	chunk.lru_next = head;
+	if (head != NO_CHUNK)
+		chunks[head].lru_prev = slot;
+	else
+		tail = slot;
+	head = slot;
+}
+
+void chunk_residency_t::insert(uint32_t slot)
+{
+	push_front(slot);
+	total += chunks[slot].bytes;
+	n++;
+}
+
+void chunk_residency_t::remove(uint32_t slot)
+{
+	unlink(slot);
+	assert(total >= chunks[slot].bytes);
+	total -= chunks[slot].bytes;
+	n--;
+}
+
+void chunk_residency_t::touch(uint32_t slot)
+{
+	if (head == slot)
+		return;
+	unlink(slot);
+	push_front(slot);
+}
+
+void chunk_residency_t::set_bytes(uint32_t slot, size_t bytes)
+{
+	chunk_t& chunk = chunks[slot];
+	total = total - chunk.bytes + bytes;
+	chunk.bytes = bytes;
+}
+
+// chunks in view are still in use even if they haven't been requested since the camera
+// moved, so those passed on the way are moved to the front; the scan only counts the others
+uint32_t chunk_residency_t::victim(const glm::ivec3& center, int keep)
+{
+	uint32_t best = NO_CHUNK;
+	int best_dist = keep;
+	size_t scanned = 0;
+	uint32_t slot = tail;
+	for (size_t steps = 0; steps < n && scanned < SCAN && slot != NO_CHUNK; steps++) {
+		const chunk_t& c = chunks[slot];
+		const uint32_t prev = c.lru_prev;
+		const glm::ivec3 d = glm::abs(c.coord - center);
+		const int dist = std::max(d.x, std::max(d.y, d.z));
+		if (dist <= keep || (pinned && c.edited)) {
+			touch(slot);
+		} else {
+			scanned++;
+			if (dist > best_dist) {
+				best_dist = dist;
+				best = slot;
+			}
+		}
+		slot = prev;
+	}
+	return best;
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec3.hpp>
+#include "ChunkMap.h"
+
+//////////////////////////////////////////////////////////////
+// Tracks which chunks stay resident. Chunks sit in an intrusive
+// LRU list (most recently requested first), linked by slot index
+// in `chunks`, and carry their own byte cost. When the total goes
+// over budget the victim is the farthest chunk, among the few
+// least recently used ones, that is outside the view; so eviction
+// costs O(1) amortized and never needs a sort of the whole cache.
+//////////////////////////////////////////////////////////////
+class chunk_residency_t {
+public:
+	// how many of the least recently used chunks `victim` looks at
+	static const size_t SCAN = 16;
+
+	chunk_residency_t(chunk_map_t& chunks);
+
+	void set_budget(size_t bytes);
+	// never pick chunks with edits (see chunk_t::edited)
+	inline void pin_edited(bool pin) { pinned = pin; }
+	inline size_t budget() const { return limit; }
+	inline size_t bytes() const { return total; }
+	inline size_t count() const { return n; }
+	inline bool over_budget() const { return total > limit; }
+
+	void insert(uint32_t slot);
+	void remove(uint32_t slot);
+	// mark as most recently used
+	void touch(uint32_t slot);
+	void set_bytes(uint32_t slot, size_t bytes);
+
+	// slot to recycle, or NO_CHUNK if none of the oldest ones is more than `keep` chunks away from
+	// `center`. chunks within `keep` (and pinned ones) are moved to the front as they are passed
+	uint32_t victim(const glm::ivec3& center, int keep);
+
+private:
+	void unlink(uint32_t slot);
+	void push_front(uint32_t slot);
+
+	chunk_map_t& chunks;
+	uint32_t head;
+	uint32_t tail;
+	size_t n;
+	size_t total;
+	size_t limit;
+	bool pinned;
+};
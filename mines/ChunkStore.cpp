@@ -0,0 +1,477 @@
+#include "ChunkStore.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <filesystem>
+#include <Tracy.hpp>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const size_t REGION_3 = chunk_store_t::REGION_SIZE * chunk_store_t::REGION_SIZE * chunk_store_t::REGION_SIZE;
+static const char REGION_MAGIC[4] = { 'M', 'R', 'G', 'N' };
+// bump whenever the record layout, the generator or the vertex format changes
+static const uint32_t REGION_VERSION = 3;
+// regions kept open at once; the least recently used one no worker is using is closed past this
+static const size_t MAX_OPEN_REGIONS = 64;
+// a region file is compacted when it is opened with more than this many bytes of
+// replaced records, and more of them than live ones
+static const uint64_t COMPACT_MIN_WASTE = 1u << 20;
+
+struct region_entry_t {
+	uint64_t offset;
+	uint32_t size;
+	uint32_t unused;
+};
+
+struct region_header_t {
+	char magic[4];
+	uint32_t version;
+	region_entry_t entries[REGION_3];
+};
+
+////////////////////////////////////////////
+// FILES
+////////////////////////////////////////////
+#ifdef _WIN32
+typedef HANDLE file_handle_t;
+static const file_handle_t NO_FILE = INVALID_HANDLE_VALUE;
+#else
+typedef int file_handle_t;
+static const file_handle_t NO_FILE = -1;
+#endif
+
+static file_handle_t open_file(const std::string& path)
+{
+#ifdef _WIN32
+	return CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+	return ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+}
+
+static void close_file(file_handle_t f)
+{
+#ifdef _WIN32
+	CloseHandle(f);
+#else
+	::close(f);
+#endif
+}
+
+static uint64_t file_size(file_handle_t f)
+{
+#ifdef _WIN32
+	LARGE_INTEGER size;
+	return GetFileSizeEx(f, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+	struct stat st;
+	return fstat(f, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+}
+
+static bool write_at(file_handle_t f, uint64_t offset, const void* data, size_t size)
+{
+	const uint8_t* src = static_cast<const uint8_t*>(data);
+	while (size > 0) {
+#ifdef _WIN32
+		OVERLAPPED ov = {};
+		ov.Offset = static_cast<DWORD>(offset);
+		ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD written = 0;
+		const DWORD chunk = static_cast<DWORD>(size > 0x40000000 ? 0x40000000 : size);
+		if (!WriteFile(f, src, chunk, &written, &ov) || written == 0)
+			return false;
+#else
+		const ssize_t written = pwrite(f, src, size, static_cast<off_t>(offset));
+		if (written <= 0)
+			return false;
+#endif
+		src += written;
+		offset += written;
+		size -= written;
+	}
+	return true;
+}
+
+// read-only view of the first `size` bytes of a file, unmapped when the last user lets go
+struct file_view_t {
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+#endif
+
+	file_view_t() = default;
+	file_view_t(const file_view_t&) = delete;
+	file_view_t& operator=(const file_view_t&) = delete;
+
+	~file_view_t()
+	{
+		if (!data)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+		CloseHandle(mapping);
+#else
+		munmap(const_cast<uint8_t*>(data), size);
+#endif
+	}
+};
+
+static std::shared_ptr<file_view_t> map_file(file_handle_t f, uint64_t size)
+{
+	std::shared_ptr<file_view_t> view = std::make_shared<file_view_t>();
+#ifdef _WIN32
+	view->mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+	if (!view->mapping)
+		return nullptr;
+	view->data = static_cast<const uint8_t*>(MapViewOfFile(view->mapping, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size)));
+	if (!view->data) {
+		CloseHandle(view->mapping);
+		return nullptr;
+	}
+#else
+	void* p = mmap(nullptr, static_cast<size_t>(size), PROT_READ, MAP_SHARED, f, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+	view->data = static_cast<const uint8_t*>(p);
+#endif
+	view->size = static_cast<size_t>(size);
+	return view;
+}
+
+////////////////////////////////////////////
+// REGIONS
+////////////////////////////////////////////
+struct chunk_store_t::region_t {
+	std::mutex mtx;
+	file_handle_t file = NO_FILE;
+	// where the next record goes
+	uint64_t end = 0;
+	uint64_t last_use = 0;
+	region_header_t header;
+	// covers at least every record in `header` when not null
+	std::shared_ptr<file_view_t> view;
+
+	~region_t()
+	{
+		view.reset();
+		if (file != NO_FILE)
+			close_file(file);
+	}
+};
+
+static int floor_div(int a, int b)
+{
+	return (a >= 0 ? a : a - b + 1) / b;
+}
+
+static glm::ivec3 region_of(const glm::ivec3& coord)
+{
+	const int N = chunk_store_t::REGION_SIZE;
+	return { floor_div(coord.x, N), floor_div(coord.y, N), floor_div(coord.z, N) };
+}
+
+static size_t entry_of(const glm::ivec3& coord)
+{
+	const int N = chunk_store_t::REGION_SIZE;
+	const glm::ivec3 local = coord - N * region_of(coord);
+	return static_cast<size_t>((local.x * N + local.y) * N + local.z);
+}
+
+chunk_store_t::chunk_store_t()
+	: use_counter(0)
+{
+}
+
+chunk_store_t::~chunk_store_t()
+{
+	close();
+}
+
+bool chunk_store_t::open(const std::string& dir_)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(dir_, ec);
+	if (ec) {
+		std::printf("[store] can't create `%s`: %s\n", dir_.c_str(), ec.message().c_str());
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	dir = dir_;
+	return true;
+}
+
+void chunk_store_t::close()
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	regions.clear();
+	dir.clear();
+}
+
+// saves append, so a file keeps every record a chunk ever had. if most of it is records
+// the header no longer points at, copy the live ones to a new file and swap it in.
+// false if the region can't be used anymore
+bool chunk_store_t::compact(const std::string& path, region_t& region, uint64_t& size)
+{
+	uint64_t live = 0;
+	for (const region_entry_t& entry : region.header.entries)
+		live += entry.size;
+	if (size < sizeof(region_header_t) + live)
+		return true;
+	const uint64_t waste = size - sizeof(region_header_t) - live;
+	if (waste < COMPACT_MIN_WASTE || waste < live)
+		return true;
+
+	ZoneScoped;
+	const std::string tmp = path + ".tmp";
+	std::error_code ec;
+	std::filesystem::remove(tmp, ec);
+	file_handle_t f = open_file(tmp);
+	if (f == NO_FILE)
+		return true;
+
+	region_header_t header = region.header;
+	uint64_t end = sizeof(region_header_t);
+	bool ok = true;
+	for (region_entry_t& entry : header.entries) {
+		if (entry.size == 0)
+			continue;
+		if (entry.offset + entry.size > region.view->size) {
+			entry = region_entry_t();
+			continue;
+		}
+		ok = ok && write_at(f, end, region.view->data + entry.offset, entry.size);
+		entry.offset = end;
+		end += entry.size;
+	}
+	ok = ok && write_at(f, 0, &header, sizeof(region_header_t));
+	close_file(f);
+	if (!ok) {
+		std::filesystem::remove(tmp, ec);
+		return true;
+	}
+
+	region.view.reset();
+	close_file(region.file);
+	std::filesystem::rename(tmp, path, ec);
+	region.file = open_file(path);
+	if (region.file == NO_FILE)
+		return false;
+	if (ec) {
+		// still the old file, which is fine as it is
+		std::printf("[store] can't replace `%s`: %s\n", path.c_str(), ec.message().c_str());
+		size = file_size(region.file);
+	} else {
+		std::printf("[store] compacted `%s`: %llu kB -> %llu kB\n", path.c_str(),
+			static_cast<unsigned long long>(size >> 10), static_cast<unsigned long long>(end >> 10));
+		region.header = header;
+		size = end;
+	}
+	region.view = map_file(region.file, size);
+	return true;
+}
+
+std::shared_ptr<chunk_store_t::region_t> chunk_store_t::region(const glm::ivec3& rc)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	if (dir.empty())
+		return nullptr;
+
+	auto it = regions.find(rc);
+	if (it != regions.end()) {
+		it->second->last_use = ++use_counter;
+		return it->second;
+	}
+
+	if (regions.size() >= MAX_OPEN_REGIONS) {
+		// a region a worker still holds can't go: a second copy of the file would append
+		// at the same offset. references are only taken under `mtx`, so this can't change
+		// to in use behind our back; if every region is busy, go over the limit for now
+		auto oldest = regions.end();
+		for (auto r = regions.begin(); r != regions.end(); r++) {
+			if (r->second.use_count() == 1 && (oldest == regions.end() || r->second->last_use < oldest->second->last_use))
+				oldest = r;
+		}
+		if (oldest != regions.end())
+			regions.erase(oldest);
+	}
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "r.%d.%d.%d.region", rc.x, rc.y, rc.z);
+	const std::string path = dir + "/" + name;
+
+	std::shared_ptr<region_t> region = std::make_shared<region_t>();
+	region->file = open_file(path);
+	if (region->file == NO_FILE) {
+		std::printf("[store] can't open `%s`\n", path.c_str());
+		return nullptr;
+	}
+
+	uint64_t size = file_size(region->file);
+	bool valid = false;
+	if (size >= sizeof(region_header_t)) {
+		std::shared_ptr<file_view_t> view = map_file(region->file, size);
+		if (view) {
+			std::memcpy(&region->header, view->data, sizeof(region_header_t));
+			valid = std::memcmp(region->header.magic, REGION_MAGIC, sizeof(REGION_MAGIC)) == 0
+				&& region->header.version == REGION_VERSION;
+			region->view = view;
+		}
+	}
+	if (valid && !compact(path, *region, size))
+		return nullptr;
+	if (!valid) {
+		// new file, or one from an older version: start over with an empty table
+		std::memset(&region->header, 0, sizeof(region_header_t));
+		std::memcpy(region->header.magic, REGION_MAGIC, sizeof(REGION_MAGIC));
+		region->header.version = REGION_VERSION;
+		region->view.reset();
+		if (!write_at(region->file, 0, &region->header, sizeof(region_header_t)))
+			return nullptr;
+	}
+	region->end = std::max<uint64_t>(size, sizeof(region_header_t));
+	region->last_use = ++use_counter;
+	regions.insert({ rc, region });
+	return region;
+}
+
+////////////////////////////////////////////
+// RECORDS
+////////////////////////////////////////////
+// record: u32 volume size, volume, i32 mesh mode (-1: no meshes), then for each
+// material u32 vertex count, u32 index bytes, the vertices and the raw indices
+template<typename T>
+static void put(std::vector<uint8_t>& out, const T* data, size_t count)
+{
+	const size_t at = out.size();
+	out.resize(at + count * sizeof(T));
+	if (count)
+		std::memcpy(&out[at], data, count * sizeof(T));
+}
+
+template<typename T>
+static bool get(const uint8_t*& src, const uint8_t* end, T* data, size_t count)
+{
+	if (static_cast<size_t>(end - src) < count * sizeof(T))
+		return false;
+	if (count)
+		std::memcpy(data, src, count * sizeof(T));
+	src += count * sizeof(T);
+	return true;
+}
+
+bool chunk_store_t::load(const glm::ivec3& coord, int mesh_mode, chunk_result_t& out, bool& has_meshes)
+{
+	ZoneScoped;
+
+	std::shared_ptr<region_t> r = region(region_of(coord));
+	if (!r)
+		return false;
+
+	std::shared_ptr<file_view_t> view;
+	region_entry_t entry;
+	{
+		std::lock_guard<std::mutex> lock(r->mtx);
+		entry = r->header.entries[entry_of(coord)];
+		if (entry.size == 0)
+			return false;
+		if (!r->view || r->view->size < entry.offset + entry.size)
+			r->view = map_file(r->file, r->end);
+		view = r->view;
+	}
+	if (!view || view->size < entry.offset + entry.size)
+		return false;
+
+	const uint8_t* src = view->data + entry.offset;
+	const uint8_t* end = src + entry.size;
+
+	uint32_t volume_size;
+	if (!get(src, end, &volume_size, 1) || static_cast<size_t>(end - src) < volume_size)
+		return false;
+	if (!out.volume.deserialize(src, volume_size))
+		return false;
+	src += volume_size;
+
+	int32_t saved_mode;
+	has_meshes = false;
+	if (!get(src, end, &saved_mode, 1) || saved_mode < 0 || saved_mode != mesh_mode)
+		return true;
+
+	bool complete = true;
+	for (int j = 0; j < chunk_t::_COUNT && complete; j++) {
+		uint32_t counts[2] = { 0, 0 };
+		complete = get(src, end, counts, 2);
+		const uint64_t mesh_size = uint64_t(counts[0]) * sizeof(IndexedMesh::Vertex) + uint64_t(counts[1]);
+		complete = complete && static_cast<uint64_t>(end - src) >= mesh_size;
+		if (complete) {
+			out.vertices[j].resize(counts[0]);
+			out.indices[j].resize(counts[1]);
+			get(src, end, out.vertices[j].data(), counts[0]);
+			get(src, end, out.indices[j].data(), counts[1]);
+		}
+	}
+	if (!complete) {
+		// truncated record: keep the volume, let the caller remesh
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			out.vertices[j].clear();
+			out.indices[j].clear();
+		}
+		return true;
+	}
+	has_meshes = true;
+	return true;
+}
+
+void chunk_store_t::save(const glm::ivec3& coord, const chunk_result_t& chunk, int mesh_mode)
+{
+	ZoneScoped;
+
+	std::shared_ptr<region_t> r = region(region_of(coord));
+	if (!r)
+		return;
+
+	static thread_local std::vector<uint8_t> record;
+	record.clear();
+	record.resize(sizeof(uint32_t));
+	chunk.volume.serialize(record);
+	const uint32_t volume_size = static_cast<uint32_t>(record.size() - sizeof(uint32_t));
+	std::memcpy(record.data(), &volume_size, sizeof(uint32_t));
+
+	const int32_t saved_mode = mesh_mode;
+	put(record, &saved_mode, 1);
+	if (mesh_mode >= 0) {
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			const uint32_t counts[2] = {
+				static_cast<uint32_t>(chunk.vertices[j].size()),
+				static_cast<uint32_t>(chunk.indices[j].size())
+			};
+			put(record, counts, 2);
+			put(record, chunk.vertices[j].data(), chunk.vertices[j].size());
+			put(record, chunk.indices[j].data(), chunk.indices[j].size());
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(r->mtx);
+	const size_t idx = entry_of(coord);
+	region_entry_t& entry = r->header.entries[idx];
+	// the record goes in before the entry points at it, so a crash loses at most this chunk
+	if (!write_at(r->file, r->end, record.data(), record.size()))
+		return;
+	entry.offset = r->end;
+	entry.size = static_cast<uint32_t>(record.size());
+	r->end += record.size();
+	const uint64_t entry_pos = offsetof(region_header_t, entries) + idx * sizeof(region_entry_t);
+	write_at(r->file, entry_pos, &entry, sizeof(region_entry_t));
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+#include <glm/vec3.hpp>
+#include "ChunkLoader.h"
+
+//////////////////////////////////////////////////////////////
+// On-disk chunk store. Chunks are grouped in region files of
+// REGION_SIZE^3 chunks: a fixed header with one (offset, size)
+// entry per chunk, followed by appended records holding the
+// compressed block volume and, optionally, the chunk meshes.
+// Records are read through a read-only memory mapping of the
+// file; saves append a new record and repoint the entry, and
+// files mostly made of replaced records are compacted on open.
+// Safe to use from the loader workers.
+//////////////////////////////////////////////////////////////
+class chunk_store_t {
+public:
+	static const int REGION_SIZE = 8;
+
+	chunk_store_t();
+	~chunk_store_t();
+
+	// use `dir` (created if needed) for region files
+	bool open(const std::string& dir);
+	void close();
+
+	// fills `out.volume` and, if they were saved for `mesh_mode`, the meshes
+	bool load(const glm::ivec3& coord, int mesh_mode, chunk_result_t& out, bool& has_meshes);
+	// `mesh_mode` < 0 saves the volume only
+	void save(const glm::ivec3& coord, const chunk_result_t& chunk, int mesh_mode);
+
+private:
+	struct region_t;
+
+	std::shared_ptr<region_t> region(const glm::ivec3& region_coord);
+	// rewrite a region file without its replaced records, if they make up most of it
+	static bool compact(const std::string& path, region_t& region, uint64_t& size);
+
+	std::mutex mtx;
+	std::string dir;
+	uint64_t use_counter;
+	std::unordered_map<glm::ivec3, std::shared_ptr<region_t>> regions;
+};
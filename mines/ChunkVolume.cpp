@@ -0,0 +1,217 @@
+#include "ChunkVolume.h"
+#include <cassert>
+#include <cstring>
+
+chunk_volume_t::chunk_volume_t()
+	: value(0)
+{
+}
+
+void chunk_volume_t::fill(block_t type)
+{
+	value = type;
+	offsets.clear();
+	offsets.shrink_to_fit();
+	runs.clear();
+	runs.shrink_to_fit();
+}
+
+void chunk_volume_t::compress(const block_t* blocks)
+{
+	size_t i = 1;
+	while (i < CHUNK_3 && blocks[i] == blocks[0])
+		i++;
+	if (i == CHUNK_3) {
+		fill(blocks[0]);
+		return;
+	}
+
+	// build runs in a scratch buffer so the stored vector is sized exactly
+	static thread_local std::vector<run_t> scratch;
+	scratch.clear();
+	offsets.resize(CHUNK_2 + 1);
+	for (size_t c = 0; c < CHUNK_2; c++) {
+		offsets[c] = static_cast<uint32_t>(scratch.size());
+		const block_t* column = &blocks[c * CHUNK_1];
+		size_t y = 0;
+		while (y < CHUNK_1) {
+			size_t len = 1;
+			while (y + len < CHUNK_1 && column[y + len] == column[y])
+				len++;
+			scratch.push_back({ column[y], static_cast<uint8_t>(len) });
+			y += len;
+		}
+	}
+	offsets[CHUNK_2] = static_cast<uint32_t>(scratch.size());
+	runs.assign(scratch.begin(), scratch.end());
+}
+
+void chunk_volume_t::decompress_column(size_t c, block_t* column) const
+{
+	for (uint32_t r = offsets[c]; r < offsets[c + 1]; r++) {
+		std::memset(column, runs[r].type, runs[r].len);
+		column += runs[r].len;
+	}
+}
+
+void chunk_volume_t::decompress(block_t* blocks) const
+{
+	if (is_uniform()) {
+		std::memset(blocks, value, CHUNK_3);
+		return;
+	}
+	for (size_t c = 0; c < CHUNK_2; c++)
+		decompress_column(c, &blocks[c * CHUNK_1]);
+}
+
+block_t chunk_volume_t::get(size_t x, size_t y, size_t z) const
+{
+	assert(x < CHUNK_1 && y < CHUNK_1 && z < CHUNK_1);
+	if (is_uniform())
+		return value;
+
+	const size_t c = x * CHUNK_1 + z;
+	size_t top = 0;
+	for (uint32_t r = offsets[c]; r < offsets[c + 1]; r++) {
+		top += runs[r].len;
+		if (y < top)
+			return runs[r].type;
+	}
+	assert(false);
+	return value;
+}
+
+// turn a uniform volume into one run per column, so it can be edited
+void chunk_volume_t::expand()
+{
+	offsets.resize(CHUNK_2 + 1);
+	runs.assign(CHUNK_2, { value, static_cast<uint8_t>(CHUNK_SIZE) });
+	for (size_t c = 0; c <= CHUNK_2; c++)
+		offsets[c] = static_cast<uint32_t>(c);
+}
+
+void chunk_volume_t::set(size_t x, size_t y, size_t z, block_t type)
+{
+	assert(x < CHUNK_1 && y < CHUNK_1 && z < CHUNK_1);
+	if (get(x, y, z) == type)
+		return;
+	if (is_uniform())
+		expand();
+
+	// re-encode the touched column and splice it back in
+	const size_t c = x * CHUNK_1 + z;
+	block_t column[CHUNK_SIZE];
+	decompress_column(c, column);
+	column[y] = type;
+
+	run_t encoded[CHUNK_SIZE];
+	size_t n = 0;
+	for (size_t i = 0; i < CHUNK_1; ) {
+		size_t len = 1;
+		while (i + len < CHUNK_1 && column[i + len] == column[i])
+			len++;
+		encoded[n++] = { column[i], static_cast<uint8_t>(len) };
+		i += len;
+	}
+
+	const size_t old_n = offsets[c + 1] - offsets[c];
+	auto first = runs.begin() + offsets[c];
+	if (n > old_n) {
+		runs.insert(first + old_n, n - old_n, run_t{});
+	} else if (n < old_n) {
+		runs.erase(first + n, first + old_n);
+	}
+	std::memcpy(&runs[offsets[c]], encoded, n * sizeof(run_t));
+	const int64_t delta = static_cast<int64_t>(n) - static_cast<int64_t>(old_n);
+	if (delta != 0) {
+		for (size_t i = c + 1; i <= CHUNK_2; i++)
+			offsets[i] = static_cast<uint32_t>(offsets[i] + delta);
+	}
+}
+
+void chunk_volume_t::occupancy(block_t empty, uint64_t bricks[8]) const
+{
+	if (is_uniform()) {
+		for (size_t b = 0; b < 8; b++)
+			bricks[b] = value == empty ? 0 : ~0ull;
+		return;
+	}
+	for (size_t b = 0; b < 8; b++)
+		bricks[b] = 0;
+	for (size_t c = 0; c < CHUNK_2; c++) {
+		const size_t bx = c / CHUNK_1 / 8, bz = c % CHUNK_1 / 8;
+		size_t y = 0;
+		for (uint32_t r = offsets[c]; r < offsets[c + 1]; r++) {
+			if (runs[r].type != empty) {
+				for (size_t by = y / 8; by <= (y + runs[r].len - 1) / 8; by++)
+					bricks[bx] |= 1ull << (bz * 8 + by);
+			}
+			y += runs[r].len;
+		}
+	}
+}
+
+size_t chunk_volume_t::bytes() const
+{
+	return sizeof(*this) + offsets.capacity() * sizeof(uint32_t) + runs.capacity() * sizeof(run_t);
+}
+
+// encoding: u8 uniform, u8 value, then for non-uniform volumes u32 run count,
+// CHUNK_2 + 1 u32 column offsets and the runs as (type, len) byte pairs
+void chunk_volume_t::serialize(std::vector<uint8_t>& out) const
+{
+	out.push_back(is_uniform() ? 1 : 0);
+	out.push_back(value);
+	if (is_uniform())
+		return;
+
+	const uint32_t n = static_cast<uint32_t>(runs.size());
+	const size_t at = out.size();
+	out.resize(at + sizeof(n) + offsets.size() * sizeof(uint32_t) + runs.size() * sizeof(run_t));
+	uint8_t* dst = &out[at];
+	std::memcpy(dst, &n, sizeof(n));
+	dst += sizeof(n);
+	std::memcpy(dst, offsets.data(), offsets.size() * sizeof(uint32_t));
+	dst += offsets.size() * sizeof(uint32_t);
+	std::memcpy(dst, runs.data(), runs.size() * sizeof(run_t));
+}
+
+bool chunk_volume_t::deserialize(const uint8_t* data, size_t size)
+{
+	static_assert(sizeof(run_t) == 2, "runs are stored as byte pairs");
+	if (size < 2)
+		return false;
+	if (data[0]) {
+		fill(data[1]);
+		return true;
+	}
+
+	uint32_t n;
+	const size_t offsets_size = (CHUNK_2 + 1) * sizeof(uint32_t);
+	if (size < 2 + sizeof(n) + offsets_size)
+		return false;
+	std::memcpy(&n, data + 2, sizeof(n));
+	if (size != 2 + sizeof(n) + offsets_size + n * sizeof(run_t))
+		return false;
+
+	std::vector<uint32_t> new_offsets(CHUNK_2 + 1);
+	std::memcpy(new_offsets.data(), data + 2 + sizeof(n), offsets_size);
+	if (new_offsets[0] != 0 || new_offsets[CHUNK_2] != n)
+		return false;
+	std::vector<run_t> new_runs(n);
+	std::memcpy(new_runs.data(), data + 2 + sizeof(n) + offsets_size, n * sizeof(run_t));
+	for (size_t c = 0; c < CHUNK_2; c++) {
+		if (new_offsets[c] >= new_offsets[c + 1])
+			return false;
+		size_t height = 0;
+		for (uint32_t r = new_offsets[c]; r < new_offsets[c + 1]; r++)
+			height += new_runs[r].len;
+		if (height != CHUNK_1)
+			return false;
+	}
+
+	value = data[1];
+	offsets.swap(new_offsets);
+	runs.swap(new_runs);
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Globals.h"
+
+//////////////////////////////////////////////////////////////
+// Compressed block storage for one chunk. A chunk made of a
+// single block type is just that value; anything else is kept
+// as runs of equal blocks along each y column (terrain columns
+// are usually 1-3 runs), with a per-column index into the runs
+// for random access.
+//////////////////////////////////////////////////////////////
+class chunk_volume_t {
+public:
+	chunk_volume_t();
+
+	// dense blocks are laid out as [x * CHUNK_2 + z * CHUNK_SIZE + y]
+	void compress(const block_t* blocks);
+	void decompress(block_t* blocks) const;
+	void fill(block_t type);
+
+	block_t get(size_t x, size_t y, size_t z) const;
+	void set(size_t x, size_t y, size_t z, block_t type);
+
+	inline bool is_uniform() const
+	{
+		return runs.empty();
+	}
+
+	// only meaningful if `is_uniform()`
+	inline block_t uniform_value() const
+	{
+		return value;
+	}
+
+	// one bit per 8x8x8 brick holding anything but `empty`: bit (bz * 8 + by) of bricks[bx]
+	void occupancy(block_t empty, uint64_t bricks[8]) const;
+
+	// heap + inline bytes held by this volume
+	size_t bytes() const;
+
+	// flat little-endian encoding, appended to `out`
+	void serialize(std::vector<uint8_t>& out) const;
+	// returns false (and leaves the volume unchanged) if `data` is not a valid encoding
+	bool deserialize(const uint8_t* data, size_t size);
+
+private:
+	struct run_t {
+		block_t type;
+		uint8_t len;
+	};
+
+	void decompress_column(size_t c, block_t* column) const;
+	void expand();
+
+	block_t value;
+	// runs of column c are [offsets[c], offsets[c + 1])
+	std::vector<uint32_t> offsets;
+	std::vector<run_t> runs;
+};
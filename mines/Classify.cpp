@@ -0,0 +1,164 @@
+#include "Classify.h"
+#include "Chunk.h"
+#include <cassert>
+#include <cstring>
+#include <Tracy.hpp>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CLASSIFY_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CLASSIFY_AVX2
+#else
+#define CLASSIFY_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// compare every block against its column's elevation and check the result
+// against the scalar kernel
+//#define CLASSIFY_VALIDATE
+
+// heights of the blocks of one chunk row and what goes above the ground at each
+// height, shared by every column of the chunk
+struct row_tables_t {
+	alignas(32) float tests[CHUNK_SIZE];
+	alignas(32) block_t above[CHUNK_SIZE];
+};
+
+static void make_row_tables(int chunk_y, row_tables_t& rows)
+{
+	for (size_t y = 0; y < CHUNK_1; y++) {
+		// must match `classify_block` exactly
+		const float test = (float)chunk_y + (float)y / (float)CHUNK_SIZE;
+		rows.tests[y] = test;
+		rows.above[y] = test >= 0.f ? chunk_t::AIR : chunk_t::WATER;
+	}
+}
+
+typedef void (*classify_fn)(const row_tables_t& rows, const heightmap_t& heightmap, block_t* blocks);
+
+static void classify_scalar(const row_tables_t& rows, const heightmap_t& heightmap, block_t* blocks)
+{
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			const float elevation = *heightmap.at(x, z);
+			block_t* column = &blocks[x * CHUNK_2 + z * CHUNK_1];
+			for (size_t y = 0; y < CHUNK_1; y++)
+				column[y] = rows.tests[y] > elevation ? rows.above[y] : (block_t)chunk_t::GRASS;
+		}
+	}
+}
+
+#ifdef CLASSIFY_X86
+static void classify_sse2(const row_tables_t& rows, const heightmap_t& heightmap, block_t* blocks)
+{
+	const __m128i grass = _mm_set1_epi8((char)chunk_t::GRASS);
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			const __m128 elevation = _mm_set1_ps(*heightmap.at(x, z));
+			block_t* column = &blocks[x * CHUNK_2 + z * CHUNK_1];
+			for (size_t y = 0; y < CHUNK_1; y += 16) {
+				// 16 compares -> 16 byte masks, packing keeps them in order
+				const __m128i c0 = _mm_castps_si128(_mm_cmpgt_ps(_mm_load_ps(&rows.tests[y + 0]), elevation));
+				const __m128i c1 = _mm_castps_si128(_mm_cmpgt_ps(_mm_load_ps(&rows.tests[y + 4]), elevation));
+				const __m128i c2 = _mm_castps_si128(_mm_cmpgt_ps(_mm_load_ps(&rows.tests[y + 8]), elevation));
+				const __m128i c3 = _mm_castps_si128(_mm_cmpgt_ps(_mm_load_ps(&rows.tests[y + 12]), elevation));
+				const __m128i mask = _mm_packs_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+				const __m128i above = _mm_load_si128(reinterpret_cast<const __m128i*>(&rows.above[y]));
+				const __m128i out = _mm_or_si128(_mm_and_si128(mask, above), _mm_andnot_si128(mask, grass));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&column[y]), out);
+			}
+		}
+	}
+}
+
+CLASSIFY_AVX2
+static void classify_avx2(const row_tables_t& rows, const heightmap_t& heightmap, block_t* blocks)
+{
+	const __m256i grass = _mm256_set1_epi8((char)chunk_t::GRASS);
+	// packing works within 128-bit lanes; this puts the dwords back in y order
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			const __m256 elevation = _mm256_set1_ps(*heightmap.at(x, z));
+			block_t* column = &blocks[x * CHUNK_2 + z * CHUNK_1];
+			for (size_t y = 0; y < CHUNK_1; y += 32) {
+				const __m256i c0 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_load_ps(&rows.tests[y + 0]), elevation, _CMP_GT_OQ));
+				const __m256i c1 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_load_ps(&rows.tests[y + 8]), elevation, _CMP_GT_OQ));
+				const __m256i c2 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_load_ps(&rows.tests[y + 16]), elevation, _CMP_GT_OQ));
+				const __m256i c3 = _mm256_castps_si256(_mm256_cmp_ps(_mm256_load_ps(&rows.tests[y + 24]), elevation, _CMP_GT_OQ));
+				const __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(c0, c1), _mm256_packs_epi32(c2, c3));
+				const __m256i mask = _mm256_permutevar8x32_epi32(packed, order);
+				const __m256i above = _mm256_load_si256(reinterpret_cast<const __m256i*>(&rows.above[y]));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(&column[y]), _mm256_blendv_epi8(grass, above, mask));
+			}
+		}
+	}
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx)
+		return false;
+	// the OS must save the ymm registers
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+struct classify_kernel_t {
+	classify_fn fn;
+	const char* name;
+};
+
+static classify_kernel_t select_kernel()
+{
+#ifdef CLASSIFY_X86
+	if (cpu_has_avx2())
+		return { classify_avx2, "avx2" };
+	return { classify_sse2, "sse2" };
+#else
+	return { classify_scalar, "scalar" };
+#endif
+}
+
+static const classify_kernel_t& kernel()
+{
+	static const classify_kernel_t k = select_kernel();
+	return k;
+}
+
+const char* classify_kernel_name()
+{
+	return kernel().name;
+}
+
+void classify_chunk(int chunk_y, const heightmap_t& heightmap, block_t* blocks)
+{
+	ZoneScoped;
+
+	row_tables_t rows;
+	make_row_tables(chunk_y, rows);
+	kernel().fn(rows, heightmap, blocks);
+
+#ifdef CLASSIFY_VALIDATE
+	static thread_local block_t ref[CHUNK_3];
+	classify_scalar(rows, heightmap, ref);
+	assert(std::memcmp(ref, blocks, CHUNK_3) == 0);
+#endif
+}
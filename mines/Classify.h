@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Globals.h"
+#include "HeightmapCache.h"
+
+// fill the dense blocks of a chunk in row `chunk_y` (which must be inside the
+// generated range) from the elevation of its columns. vectorized with the widest
+// instruction set the cpu supports, picked once on first use; the result is the
+// same block for block on every path.
+void classify_chunk(int chunk_y, const heightmap_t& heightmap, block_t* blocks);
+
+// name of the kernel `classify_chunk` runs, for logging
+const char* classify_kernel_name();
@@ -1,5 +1,9 @@
 #include "EntityManager.h"
 
+// ids of the component types, by index. like the rest of the manager, not thread-safe
+static uint32_t component_ids[entity_manager_t::MAX_COMPONENTS];
+static uint32_t num_components = 0;
+
 entity_manager_t::entity_manager_t()
 	: empty_state_stream(0)
 {
@@ -9,6 +13,25 @@ entity_manager_t::~entity_manager_t()
 {
 }
 
+uint32_t entity_manager_t::register_component(const uint32_t cID)
+{
+	uint32_t ci = find_component(cID);
+	if (ci != NO_COMPONENT)
+		return ci;
+	assert(num_components < MAX_COMPONENTS);
+	component_ids[num_components] = cID;
+	return num_components++;
+}
+
+uint32_t entity_manager_t::find_component(const uint32_t cID)
+{
+	for (uint32_t i = 0; i < num_components; i++) {
+		if (component_ids[i] == cID)
+			return i;
+	}
+	return NO_COMPONENT;
+}
+
 void entity_manager_t::new_entity(entity_t* es, size_t ct)
 {
 	size_t i = 0;
@@ -38,11 +61,11 @@ void entity_manager_t::free_entity(entity_t* es, size_t ct)
 
 state_stream_t* entity_manager_t::get_state_stream(uint32_t cID)
 {
-	auto it = changelogs.find(cID);
-	if (it == changelogs.end()) {
+	const uint32_t ci = find_component(cID);
+	if (ci == NO_COMPONENT) {
 		return &empty_state_stream;
 	}
-	return &it->second;
+	return &changelogs[ci];
 }
 
 void entity_manager_t::materialize()
@@ -53,10 +76,13 @@ void entity_manager_t::materialize()
 	//  first process insertions, then deletions, and
 	//  finally updates
 	////////////////////////////////////////////////////
-	for (auto& chlog : changelogs) {
-		uint32_t cID = chlog.first;
-		state_stream_t* ss = &chlog.second;
-		packed_array_t<entity_t>* store = get_store_or_default(cID, ss->csize);
+	for (uint32_t ci = 0; ci < num_components; ci++) {
+		state_stream_t* ss = &changelogs[ci];
+		if (ss->events.empty()) {
+			ss->swap();
+			continue;
+		}
+		packed_array_t<entity_t>* store = get_store_or_default(ci, ss->csize);
 		for (auto& msg : ss->events) {
 			switch (msg.type) {
 			case state_msg_header_t::C_UPDATE:
@@ -77,12 +103,20 @@ void entity_manager_t::materialize()
 
 std::vector<entity_t> entity_manager_t::join(const uint32_t aID, const uint32_t bID)
 {
-	auto storeA = get_store(aID);
-	auto storeB = get_store(bID);
-	assert(storeA != nullptr && storeB != nullptr);
+	const uint32_t a = find_component(aID);
+	const uint32_t b = find_component(bID);
+	assert(a != NO_COMPONENT && b != NO_COMPONENT);
+	return join_at(a, b);
+}
+
+std::vector<entity_t> entity_manager_t::join_at(const uint32_t a, const uint32_t b)
+{
+	auto storeA = &stores[a];
+	auto storeB = &stores[b];
+	assert(storeA->capacity() > 0 && storeB->capacity() > 0);
 
 	if (storeA->size() > storeB->size()) {
-		return join(bID, aID);
+		return join_at(b, a);
 	}
 
 	std::vector<entity_t> out;
@@ -2,7 +2,6 @@
 
 #include <deque>
 #include <vector>
-#include <unordered_map>
 
 #include "Entity.h"
 #include "PackedArray.h"
@@ -22,7 +21,7 @@ struct state_msg_header_t {
 //       locality when materializing the ss
 //////////////////////////////////////////////////////////////
 struct state_stream_t {
-	state_stream_t(size_t csize)
+	state_stream_t(size_t csize = 0)
 		: csize(csize)
 	{
 	}
@@ -67,13 +66,16 @@ struct state_stream_t {
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////
-// TODO: right now, accessing a component chases __4 pointers__
-//       (map -> store -> sparse -> dense -> data)
-//       if we avoid unordered_map, keep our stores as a packed_array_t[MAX_COMPONENTS],
-//       and merge the dense-data arrays, we could cut down to 2 pointers chased
+// Component types get a dense index the first time they are used (see `index`), so
+// stores and state streams are plain arrays indexed by it. A store's sparse array holds
+// each entity's data slot, so accessing a component chases 2 pointers (sparse -> data).
+// Overloads taking a component id look the index up instead, by a scan over the types.
 ////////////////////////////////////////////////////////////////////////////////////////
 class entity_manager_t {
 public:
+	static const uint32_t MAX_COMPONENTS = 32;
+	static const uint32_t NO_COMPONENT = ~0u;
+
 	template<typename T>
 	struct collection_t {
 		size_t size;
@@ -87,87 +89,79 @@ public:
 	void new_entity(entity_t* es, size_t ct);
 	void free_entity(entity_t *es, size_t ct);
 
+	// dense index of a component type, the same for every manager
+	template<typename C>
+	static uint32_t index()
+	{
+		static const uint32_t idx = register_component(C::id());
+		return idx;
+	}
+
 	template<typename C>
 	void insert_component(entity_t e, const uint32_t cID, C&& component)
 	{
-		auto ss = get_ss_or_default<C>(cID);
-		auto store = get_store_or_default(cID, sizeof(C));
-		if (store->has(e)) {
-			ss->push_insert<C>(e, component, true);
-		} else {
-			ss->push_insert<C>(e, component, false);
-		}
+		insert_at<C>(e, register_component(cID), component);
 	}
 
 	template<typename C>
 	void insert_component(entity_t e, const uint32_t cID, C& component)
 	{
-		auto ss = get_ss_or_default<C>(cID);
-		auto store = get_store_or_default(cID, sizeof(C));
-		if (store->has(e)) {
-			ss->push_insert<C>(e, component, true);
-		}
-		else {
-			ss->push_insert<C>(e, component, false);
-		}
+		insert_at<C>(e, register_component(cID), component);
 	}
 
 	template<typename C>
 	inline void insert_component(entity_t e, C&& component)
 	{
-		insert_component<C>(e, C::id(), std::move(component));
+		insert_at<C>(e, index<C>(), component);
 	}
 
 	template<typename C>
 	inline void insert_component(entity_t e, C& component)
 	{
-		insert_component<C>(e, C::id(), component);
+		insert_at<C>(e, index<C>(), component);
 	}
 
 	template<typename C>
 	C& get_component(entity_t e, const uint32_t cID)
 	{
-		auto it = stores.find(cID);
-		assert(it != stores.end());
-		return it->second.get<C>(e);
+		const uint32_t ci = find_component(cID);
+		assert(ci != NO_COMPONENT);
+		return stores[ci].get<C>(e);
 	}
 
 	template<typename C>
 	inline C& get_component(entity_t e)
 	{
-		return get_component<C>(e, C::id());
+		packed_array_t<entity_t>& store = stores[index<C>()];
+		return store.get<C>(e);
 	}
 
 	template<typename C>
 	void delete_component(entity_t e)
 	{
-		auto ss = get_ss_or_default<C>(C::id());
+		auto ss = get_ss_or_default(index<C>(), sizeof(C));
 		ss->push_delete(e);
 	}
 
 	template<typename C>
 	bool has_component(entity_t e)
 	{
-		auto it = stores.find(C::id());
-		if (it == stores.end())
-			return false;
-		return it->second.has(e);
+		return stores[index<C>()].has(e);
 	}
 
 	template<typename C>
 	collection_t<C*> any(const uint32_t cID)
 	{
-		auto it = stores.find(cID);
-		if (it == stores.end())
+		const uint32_t ci = find_component(cID);
+		if (ci == NO_COMPONENT)
 			return collection_t<C*>{ 0 };
-		auto pair = it->second->any_pair<C>();
-		return { it->second->size(), pair.first, pair.second };
+		return any_at<C>(ci);
 	}
 
 	template<typename C>
 	inline collection_t<C*> any()
 	{
-		return any<C>(C::id());
+		return any_at<C>(index<C>());
 	}
 
 	std::vector<entity_t> join(const uint32_t aID, const uint32_t bID);
@@ -175,7 +169,7 @@ public:
 	template<typename A, typename B>
 	inline std::vector<entity_t> join()
 	{
-		return join(A::id(), B::id());
+		return join_at(index<A>(), index<B>());
 	}
 
 	void materialize();
@@ -185,50 +179,66 @@ public:
 	template<typename C>
 	inline state_stream_t* get_state_stream()
 	{
-		return get_state_stream(C::id());
+		return &changelogs[index<C>()];
 	}
 
 	template<typename C>
 	void print()
 	{
-		auto store = get_store_or_default(C::id(), sizeof(C));
+		auto store = get_store_or_default(index<C>(), sizeof(C));
 		store->print();
 	}
 
 private:
+	// index of component id `cID`, given a new one if it has none yet
+	static uint32_t register_component(const uint32_t cID);
+	// index of component id `cID`, or NO_COMPONENT
+	static uint32_t find_component(const uint32_t cID);
+
 	template<typename C>
-	state_stream_t* get_ss_or_default(const uint32_t cID)
+	void insert_at(entity_t e, const uint32_t ci, C& component)
 	{
-		auto it = changelogs.find(cID);
-		if (it == changelogs.end()) {
-			it = changelogs.emplace(cID, state_stream_t(sizeof(C))).first;
+		auto ss = get_ss_or_default(ci, sizeof(C));
+		auto store = get_store_or_default(ci, sizeof(C));
+		if (store->has(e)) {
+			ss->push_insert<C>(e, component, true);
+		} else {
+			ss->push_insert<C>(e, component, false);
 		}
-		return &it->second;
 	}
 
-	packed_array_t<entity_t>* get_store(const uint32_t cID)
+	template<typename C>
+	collection_t<C*> any_at(const uint32_t ci)
 	{
-		auto it = stores.find(cID);
-		if (it == stores.end()) {
-			return nullptr;
-		}
-		return &it->second;
+		auto pair = stores[ci].any_pair<C>();
+		return { stores[ci].size(), pair.first, pair.second };
 	}
 
-	packed_array_t<entity_t>* get_store_or_default(const uint32_t cID, const size_t elt_sz)
+	std::vector<entity_t> join_at(const uint32_t a, const uint32_t b);
+
+	state_stream_t* get_ss_or_default(const uint32_t ci, const size_t elt_sz)
 	{
-		auto it = stores.find(cID);
-		if (it == stores.end()) {
-			it = stores.emplace(cID, packed_array_t<entity_t>(elt_sz, 0x4000)).first;
-		}
-		return &it->second;
+		state_stream_t* ss = &changelogs[ci];
+		if (ss->csize == 0)
+			ss->csize = elt_sz;
+		assert(ss->csize == elt_sz);
+		return ss;
+	}
+
+	packed_array_t<entity_t>* get_store_or_default(const uint32_t ci, const size_t elt_sz)
+	{
+		packed_array_t<entity_t>* store = &stores[ci];
+		if (store->capacity() == 0)
+			*store = packed_array_t<entity_t>(elt_sz, 0x4000);
+		return store;
 	}
 
 	std::vector<entity_t> entities;
 	std::deque<entity_t> free_entities;
 
-	std::unordered_map<uint32_t, packed_array_t<entity_t>> stores;
-	std::unordered_map<uint32_t, state_stream_t> changelogs;
+	// by component index; empty until the type is first used
+	packed_array_t<entity_t> stores[MAX_COMPONENTS];
+	state_stream_t changelogs[MAX_COMPONENTS];
 
 	state_stream_t empty_state_stream;
 };
\ No newline at end of file
@@ -1,3 +1,13 @@
 #pragma once
 
-inline const int CHUNK_SIZE = 64;
\ No newline at end of file
+#include <cstddef>
+#include <cstdint>
+
+inline const int CHUNK_SIZE = 64;
+
+inline const size_t CHUNK_1 = static_cast<size_t>(CHUNK_SIZE);
+inline const size_t CHUNK_2 = CHUNK_1 * CHUNK_1;
+inline const size_t CHUNK_3 = CHUNK_2 * CHUNK_1;
+
+// one block id; see the chunk_t enum
+typedef uint8_t block_t;
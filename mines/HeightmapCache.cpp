@@ -0,0 +1,51 @@
+#include "HeightmapCache.h"
+#include <Tracy.hpp>
+
+heightmap_cache_t::heightmap_cache_t()
+	: capacity(0)
+{
+}
+
+void heightmap_cache_t::set_capacity(size_t columns)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	capacity = columns;
+	while (entries.size() > capacity) {
+		entries.erase(lru.back());
+		lru.pop_back();
+	}
+}
+
+heightmap_cache_t::handle_t heightmap_cache_t::get(const glm::ivec2& column, const build_fn& build)
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto it = entries.find(column);
+		if (it != entries.end()) {
+			lru.splice(lru.begin(), lru, it->second.lru);
+			return it->second.map;
+		}
+	}
+
+	// two workers may race to build the same column; the loser's copy is just dropped
+	std::shared_ptr<heightmap_t> map = std::make_shared<heightmap_t>();
+	{
+		ZoneScoped("heightmap_build");
+		build(column, *map);
+	}
+
+	std::lock_guard<std::mutex> lock(mtx);
+	auto it = entries.find(column);
+	if (it != entries.end())
+		return it->second.map;
+	if (capacity == 0)
+		return map;
+
+	while (entries.size() >= capacity) {
+		entries.erase(lru.back());
+		lru.pop_back();
+	}
+	lru.push_front(column);
+	entries.insert({ column, { map, lru.begin() } });
+	return map;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtx/hash.hpp>
+#include <glm/vec2.hpp>
+#include "Globals.h"
+
+// terrain elevation (in chunk units) of one column of chunks, padded by one
+// sample on each side so the neighbouring columns can be classified too
+struct heightmap_t {
+	static const size_t SIZE_1 = CHUNK_SIZE + 2;
+
+	float elevation[SIZE_1 * SIZE_1];
+	// bounds over the chunk's own CHUNK_SIZE x CHUNK_SIZE columns (no padding)
+	float min_elevation;
+	float max_elevation;
+
+	inline const float* at(int x, int z) const
+	{
+		return &elevation[(x + 1) * SIZE_1 + (z + 1)];
+	}
+};
+
+//////////////////////////////////////////////////////////////
+// Heightmaps keyed by (x, z) chunk column, shared by every chunk
+// in the vertical stack and kept around after they are evicted.
+// Bounded with an LRU; safe to use from the loader workers.
+//////////////////////////////////////////////////////////////
+class heightmap_cache_t {
+public:
+	typedef std::shared_ptr<const heightmap_t> handle_t;
+	typedef std::function<void(const glm::ivec2& column, heightmap_t& out)> build_fn;
+
+	heightmap_cache_t();
+
+	void set_capacity(size_t columns);
+	// cached heightmap for `column`, calling `build` (outside the lock) on a miss
+	handle_t get(const glm::ivec2& column, const build_fn& build);
+
+private:
+	struct entry_t {
+		handle_t map;
+		std::list<glm::ivec2>::iterator lru;
+	};
+
+	std::mutex mtx;
+	size_t capacity;
+	// most recently used first
+	std::list<glm::ivec2> lru;
+	std::unordered_map<glm::ivec2, entry_t> entries;
+};
@@ -1,13 +1,25 @@
 #pragma once
 
+#include <cstdint>
+
 struct IndexedMesh {
+	// packed chunk vertex, decoded in phong.vert
 	struct Vertex {
-		float x, y, z;
-		float nx, ny, nz;
-		float r, g, b;
+		// position inside the chunk, in blocks: [0, CHUNK_SIZE]
+		uint8_t x, y, z;
+		// bits 0-2: normal (+x, +y, +z, -x, -y, -z), bits 3-7: block type
+		uint8_t attrib;
 	};
+	// meshes of quads (4 vertices each) have no indices of their own: the renderer
+	// draws them with one shared index pattern. others use 16-bit indices when they can
+	static inline size_t index_size(size_t num_verts)
+	{
+		return num_verts <= 0x10000 ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
 	size_t num_verts;
 	size_t num_indices;
 	Vertex* vertices;
-	unsigned int* indices;
+	// null for quad meshes, else `num_indices` of `index_size(num_verts)` bytes each
+	void* indices;
 };
@@ -7,11 +7,12 @@ struct context_t;
 class input_system_t {
 public:
 	input_system_t(context_t* ctx)
-		: ctx(ctx)
+		: ctx(ctx), clicks(0)
 	{}
 
 	int update()
 	{
+		clicks = 0;
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
 			switch (e.type) {
@@ -20,6 +21,12 @@ public:
 			case SDL_KEYDOWN:
 				if (e.key.keysym.scancode == SDL_SCANCODE_Q)
 					return 1;
+				break;
+			case SDL_MOUSEBUTTONDOWN:
+				// only while the mouse steers the camera, see camera_system_t
+				if (SDL_GetRelativeMouseMode())
+					clicks |= SDL_BUTTON(e.button.button);
+				break;
 			default:
 				break;
 			}
@@ -27,8 +34,15 @@ public:
 
 		return 0;
 	}
+
+	// `button` (SDL_BUTTON_LEFT, ...) was pressed since the last `update`
+	inline bool clicked(int button) const
+	{
+		return (clicks & SDL_BUTTON(button)) != 0;
+	}
 	
 private:
 	context_t* ctx;
+	uint32_t clicks;
 };
 
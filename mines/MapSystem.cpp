@@ -2,32 +2,48 @@
 #include "Position.h"
 #include "Camera.h"
 #include <random>
-#include <sstream>
 #include "Context.h"
 #include "IndexedMesh.h"
 #include "RenderModel.h"
 #include <glm/glm.hpp>
 #include <algorithm>
 #include <array>
-#include <omp.h>
+#include <functional>
 #include "utils.h"
 #include <Tracy.hpp>
-#include <bitset>
 #include "Globals.h"
-
-static const size_t CHUNK_1 = static_cast<size_t>(CHUNK_SIZE);
-static const size_t CHUNK_2 = CHUNK_1 * CHUNK_1;
-static const size_t CHUNK_3 = CHUNK_2 * CHUNK_1;
+#include "Mesher.h"
+#include "Classify.h"
 
 #define VEC3_UNPACK(v) v.x, v.y, v.z
 #define VEC3_FMTD "(%d, %d, %d)"
 
 map_system_t::map_system_t(context_t* ctx)
-	: ctx(ctx), view_distance(0), seed(0), chunk_coord(0), n_chunks(0)
+	: ctx(ctx), view_distance(0), seed(0), chunk_coord(0), n_chunks(0), chunks_per_frame(0), ticket(0), mesh_mode(MESH_FACES), store_mode(STORE_OFF), residency(chunk_cache),
+	look(0.f, 0.f, -1.f), prioritized_look(0.f, 0.f, -1.f), cos_view(0.f),
+	prefetch_ms(0), prefetch_coord(0), prefetch_issued(0), prefetch_hits(0), prefetch_wasted(0), model_clock(0),
+	mesh_budget(0), lod_shed_at(0), shed_scan(false), meshes_dropped(0)
 {}
 
 map_system_t::~map_system_t()
-{}
+{
+	// workers reference our noise generators, so join them before they go away
+	loader.stop();
+	// edited chunks still loaded; the rest is in the store already (see `save_edited`)
+	if (store_mode != STORE_OFF) {
+		for (const chunk_t& ch : chunk_cache) {
+			if (!ch.loaded || !ch.edited)
+				continue;
+			chunk_result_t saved;
+			saved.volume = ch.volume;
+			store.save(ch.coord, saved, -1);
+		}
+	}
+	if (prefetch_ms > 0)
+		std::printf("[map] prefetch: issued=%zu hits=%zu wasted=%zu\n", prefetch_issued, prefetch_hits, prefetch_wasted);
+	if (meshes_dropped > 0)
+		std::printf("[map] mesh budget: dropped the meshes of %zu chunks\n", meshes_dropped);
+}
 
 ////////////////////////////////////////////
 // CUBE VERTEX DATA
@@ -40,14 +56,19 @@ static const glm::vec3 normals[6] = {
 	glm::normalize(glm::vec3(0.f, -1.f, 0.f)),
 	glm::normalize(glm::vec3(0.f, 0.f, -1.f)),
 };
-static const glm::vec3 normal_data[24] = {
-	normals[4], normals[4], normals[4], normals[4],
-	normals[1], normals[1], normals[1], normals[1],
-	normals[3], normals[3], normals[3], normals[3],
-	normals[0], normals[0], normals[0], normals[0],
-	normals[2], normals[2], normals[2], normals[2],
-	normals[5], normals[5], normals[5], normals[5]
+// normal (index into `normals`) of each group of 4 vertices below
+static const uint8_t slot_normal[6] = { 4, 1, 3, 0, 2, 5 };
+// corners (see `generate_quad_mesh`) that make up each of the 24 vertices above
+static const size_t cube_corners[24] = {
+	0, 1, 2, 3,		// bottom
+	4, 5, 6, 7,		// top
+	0, 1, 5, 4,		// left
+	3, 2, 6, 7,		// right
+	1, 2, 6, 5,		// front
+	0, 3, 7, 4		// back
 };
+// which group of 4 vertices above belongs to each face direction (+x, +y, +z, -x, -y, -z)
+static const size_t face_slot[6] = { 3, 1, 4, 2, 0, 5 };
 static const unsigned int indices[36] = {
 	0, 1, 2,     2, 3, 0,		// bottom
 	4, 5, 6,     6, 7, 4,		// top
@@ -58,217 +79,427 @@ static const unsigned int indices[36] = {
 };
 ////////////////////////////////////////////
 
-struct quad_t {
-	unsigned x, y, z, w, h, d;
-};
-
-//static thread_local std::bitset<CHUNK_3> greedy_bitset;
-static std::vector<quad_t> blocks_to_mesh_greedy(const int *blocks, int type)
+// colours live in phong.vert; vertices only carry the block type
+static IndexedMesh::Vertex pack_vertex(const glm::uvec3& v, unsigned normal, int type)
 {
-	std::bitset<CHUNK_3> greedy_bitset;
-	greedy_bitset.reset();
-
-	auto bit_at = [&greedy_bitset](size_t x, size_t y, size_t z) {
-		return greedy_bitset[CHUNK_2 * x + CHUNK_1 * z + y];
+	return {
+		static_cast<uint8_t>(v.x), static_cast<uint8_t>(v.y), static_cast<uint8_t>(v.z),
+		static_cast<uint8_t>(normal | (static_cast<unsigned>(type) << 3))
 	};
+}
 
-	// initialize bitset
-	for (size_t i = 0; i < CHUNK_3; i++) {
-		greedy_bitset[i] = blocks[i] == type;
+template<typename I>
+static void box_indices(I* out, size_t boxes)
+{
+	for (size_t k = 0; k < boxes; k++) {
+		for (size_t j = 0; j < 36; j++)
+			out[36 * k + j] = static_cast<I>(indices[j] + 24 * k);
 	}
+}
 
-	///////////////////////////////////////////////////////
-	// TODO: should build quads from different corners in
-	//       the chunk and then stick with the best result.
+static void generate_quad_mesh(const std::vector<quad_t>& quads, int type, std::vector<IndexedMesh::Vertex>& vertices, std::vector<uint8_t>& inds)
+{
+	vertices.resize(24 * quads.size());
 
-	// sweep 2D planes from y=0 to y=CHUNK_SIZE-1
-	std::vector<quad_t> quads;
-	for (unsigned y = 0; y < CHUNK_1; y++) {
-		for (unsigned z = 0; z < CHUNK_1; z++) {
-			for (unsigned x = 0; x < CHUNK_1; x++) {
-				// find a set block
-				if (!bit_at(x, y, z))
-					continue;
-				// otherwise, generate quad starting at (x, y, z)
-				// stretch the x axis
-				unsigned i;
-				for (i = x; i < CHUNK_1 && bit_at(i, y, z); i++) {}
-				unsigned w = i - x;
-				// stretch the z axis
-				unsigned j;
-				for (j = z + 1; j < CHUNK_1; j++) {
-					for (i = x; i < x + w && bit_at(i, y, j); i++) {}
-					if (i != x + w)
-						break;
-				}
-				unsigned d = j - z;
-				// stretch the y axis
-				unsigned k;
-				for (k = y + 1; k < CHUNK_1; k++) {
-					for (j = z; j < z + d; j++) {
-						for (i = x; i < x + w && bit_at(i, k, j); i++) {}
-						if (i != x + w)
-							break;
-					}
-					if (j != z + d)
-						break;
-				}
-				unsigned h = k - y;
-
-				// submit quad
-				quad_t q = { x, y, z, w, h, d };
-				quads.push_back(q);
-
-				// mark bitmask
-				for (i = x; i < x + w; i++) {
-					for (j = z; j < z + d; j++) {
-						for (k = y; k < y + h; k++) {
-							bit_at(i, k, j) = false;
-						}
-					}
-				}
-			}
-		}
+	for (size_t k = 0; k < quads.size(); k++) {
+		const quad_t& q = quads[k];
+
+		// vertex data
+		const glm::uvec3 quad_vs[8] = {
+			glm::uvec3(q.x, q.y, q.z),
+			glm::uvec3(q.x, q.y, q.z + q.d),
+			glm::uvec3(q.x + q.w, q.y, q.z + q.d),
+			glm::uvec3(q.x + q.w, q.y, q.z),
+			glm::uvec3(q.x, q.y + q.h, q.z),
+			glm::uvec3(q.x, q.y + q.h, q.z + q.d),
+			glm::uvec3(q.x + q.w, q.y + q.h, q.z + q.d),
+			glm::uvec3(q.x + q.w, q.y + q.h, q.z)
+		};
+		for (size_t j = 0; j < 24; j++)
+			vertices[24 * k + j] = pack_vertex(quad_vs[cube_corners[j]], slot_normal[j / 4], type);
 	}
-	return quads;
+
+	// 16-bit whenever the vertices allow it
+	const size_t index_size = IndexedMesh::index_size(vertices.size());
+	inds.resize(36 * quads.size() * index_size);
+	if (index_size == sizeof(uint16_t))
+		box_indices(reinterpret_cast<uint16_t*>(inds.data()), quads.size());
+	else
+		box_indices(reinterpret_cast<uint32_t*>(inds.data()), quads.size());
 }
 
-static glm::vec3 block_color(const int type)
+// indices come from the renderer's shared quad pattern (same winding as the cube faces)
+static void generate_face_mesh(const std::vector<face_t>& faces, int type, std::vector<IndexedMesh::Vertex>& vertices)
 {
-	switch (type) {
-	case chunk_t::GRASS:
-		return glm::vec3(0.45f, 0.74f, 0.45f);
-	case chunk_t::ROCK:
-		return glm::vec3(0.4f);
-	case chunk_t::WATER:
-		return glm::vec3(0.69f, 0.8f, 0.95f);
-	default:
-		return glm::vec3(1.f, 0.f, 0.f);
+	vertices.resize(4 * faces.size());
+
+	for (size_t k = 0; k < faces.size(); k++) {
+		const face_t& f = faces[k];
+
+		// vertex data
+		const glm::uvec3 quad_vs[8] = {
+			glm::uvec3(f.x, f.y, f.z),
+			glm::uvec3(f.x, f.y, f.z + f.d),
+			glm::uvec3(f.x + f.w, f.y, f.z + f.d),
+			glm::uvec3(f.x + f.w, f.y, f.z),
+			glm::uvec3(f.x, f.y + f.h, f.z),
+			glm::uvec3(f.x, f.y + f.h, f.z + f.d),
+			glm::uvec3(f.x + f.w, f.y + f.h, f.z + f.d),
+			glm::uvec3(f.x + f.w, f.y + f.h, f.z)
+		};
+		const size_t slot = face_slot[f.dir];
+		for (size_t j = 0; j < 4; j++)
+			vertices[4 * k + j] = pack_vertex(quad_vs[cube_corners[4 * slot + j]], f.dir, type);
 	}
 }
 
-static void generate_quad_mesh(map_system_t* map, const asset_t a, const std::vector<quad_t>& quads, int type)
+// bytes allocated for a chunk mesh
+static size_t mesh_bytes(map_system_t* map, const asset_t a)
 {
 	auto mesh = map->ctx->assets.get<IndexedMesh>(a);
-	size_t old_num_verts = mesh->num_verts;
-	mesh->num_verts = 24 * quads.size();
-	mesh->num_indices = 36 * quads.size();
+	return map->ctx->assets.get_chunk_size(a, (uint8_t*)mesh->vertices) + map->ctx->assets.get_chunk_size(a, (uint8_t*)mesh->indices);
+}
+
+// copy a finished mesh into asset memory (main thread only: the mesh contents are read by the renderer unsynchronized)
+// returns the bytes held by the mesh afterwards
+static size_t upload_mesh(map_system_t* map, const asset_t a, const std::vector<IndexedMesh::Vertex>& vertices, const std::vector<uint8_t>& inds)
+{
+	auto mesh = map->ctx->assets.get<IndexedMesh>(a);
+	// face meshes are all quads, drawn with the renderer's shared indices
+	const bool quads = map->mesh_mode == map_system_t::MESH_FACES;
+	mesh->num_verts = vertices.size();
+	mesh->num_indices = quads ? vertices.size() / 4 * 6 : inds.size() / IndexedMesh::index_size(vertices.size());
 
 	// allocate memory if needed
-	const size_t old_chunk_sz = map->ctx->assets.get_chunk_size(a, (uint8_t*)mesh->vertices) / sizeof(IndexedMesh::Vertex);
-	if (mesh->vertices == nullptr || old_chunk_sz < mesh->num_verts) {
+	const size_t old_verts = map->ctx->assets.get_chunk_size(a, (uint8_t*)mesh->vertices) / sizeof(IndexedMesh::Vertex);
+	const size_t old_index_bytes = map->ctx->assets.get_chunk_size(a, (uint8_t*)mesh->indices);
+	if (mesh->vertices == nullptr || old_verts < mesh->num_verts || old_index_bytes < inds.size()) {
 		map->ctx->assets.free_chunk(a, (uint8_t*)mesh->vertices);
 		map->ctx->assets.free_chunk(a, (uint8_t*)mesh->indices);
 		mesh->vertices = map->ctx->assets.allocate_chunk<IndexedMesh::Vertex>(a, mesh->num_verts);
-		mesh->indices = map->ctx->assets.allocate_chunk<unsigned int>(a, mesh->num_indices);
+		mesh->indices = quads ? nullptr : map->ctx->assets.allocate_chunk(a, inds.size());
 	}
 
-	glm::vec3 color = block_color(type);
+	std::memcpy(mesh->vertices, vertices.data(), vertices.size() * sizeof(IndexedMesh::Vertex));
+	if (!quads)
+		std::memcpy(mesh->indices, inds.data(), inds.size());
+	return mesh_bytes(map, a);
+}
 
-	for (size_t k = 0; k < quads.size(); k++) {
-		const quad_t& q = quads[k];
-		const glm::vec3 pos = glm::vec3(q.x, q.y, q.z);
+// bytes held by a loaded chunk, as accounted by `residency`
+static size_t chunk_bytes(map_system_t* map, const chunk_t& chunk)
+{
+	size_t bytes = sizeof(chunk_t) + chunk.volume.bytes();
+	for (int j = 0; j < chunk_t::_COUNT; j++)
+		bytes += mesh_bytes(map, chunk.meshes[j]);
+	return bytes;
+}
 
-		// vertex data
-		const glm::vec3 quad_vs[8] = {
-			glm::vec3(q.x, q.y, q.z),
-			glm::vec3(q.x, q.y, q.z + q.d),
-			glm::vec3(q.x + q.w, q.y, q.z + q.d),
-			glm::vec3(q.x + q.w, q.y, q.z),
-			glm::vec3(q.x, q.y + q.h, q.z),
-			glm::vec3(q.x, q.y + q.h, q.z + q.d),
-			glm::vec3(q.x + q.w, q.y + q.h, q.z + q.d),
-			glm::vec3(q.x + q.w, q.y + q.h, q.z)
-		};
-		const glm::vec3 quad_ids[24] = {
-			quad_vs[0], quad_vs[1], quad_vs[2], quad_vs[3],
-			quad_vs[4], quad_vs[5], quad_vs[6], quad_vs[7],
-			quad_vs[0], quad_vs[1], quad_vs[5], quad_vs[4],
-			quad_vs[3], quad_vs[2], quad_vs[6], quad_vs[7],
-			quad_vs[1], quad_vs[2], quad_vs[6], quad_vs[5],
-			quad_vs[0], quad_vs[3], quad_vs[7], quad_vs[4]
-		};
-		for (size_t j = 0; j < 24; j++) {
-			mesh->vertices[24 * k + j].x = quad_ids[j].x; mesh->vertices[24 * k + j].y = quad_ids[j].y; mesh->vertices[24 * k + j].z = quad_ids[j].z;
-			mesh->vertices[24 * k + j].nx = normal_data[j].x; mesh->vertices[24 * k + j].ny = normal_data[j].y; mesh->vertices[24 * k + j].nz = normal_data[j].z;
-			mesh->vertices[24 * k + j].r = color.r; mesh->vertices[24 * k + j].g = color.g; mesh->vertices[24 * k + j].b = color.b;
-		}
+static bool is_outside_range(int chunk_y)
+{
+	return chunk_y >= 1 || chunk_y < -1;
+}
+
+// terrain noise sample -> height of the ground, in chunk units
+static float terrain_elevation(float terrain_val)
+{
+	const float terrain_sign = terrain_val == 0.f ? 1.f : terrain_val / std::fabs(terrain_val);
+	return 1.5f * terrain_sign * std::pow(std::fabs(terrain_val), 1.9f) + 0.2f;// +0.5f;
+}
 
-		// indices
-		std::memcpy(&mesh->indices[36 * k], indices, 36 * sizeof(unsigned int));
-		for (size_t j = 0; j < 36; j++) {
-			mesh->indices[36 * k + j] += 24 * k;
+// block at local height `y` of a chunk in row `chunk_y`, above a column of the given
+// elevation (which may be null for rows outside the generated range)
+static block_t classify_block(int chunk_y, size_t y, const float* elevation)
+{
+	const float test = (float)chunk_y + (float)y / (float)CHUNK_SIZE;
+	if (is_outside_range(chunk_y))
+		return test > 0 ? chunk_t::AIR : chunk_t::GRASS;
+
+	if (test > *elevation) {
+		if (test >= 0.f) {
+			return chunk_t::AIR;
+		} else {
+			return chunk_t::WATER;
 		}
 	}
+	return chunk_t::GRASS;
 }
 
-static void generate_chunk(map_system_t *map, chunk_t& chunk, glm::ivec3 coordinate)
+// whether every block of a chunk in row `chunk_y` classifies the same, given the
+// elevation bounds of its columns; if so the block is stored in `type`
+static bool classify_uniform(int chunk_y, float min_elevation, float max_elevation, block_t& type)
 {
-	ZoneScoped;
+	if (is_outside_range(chunk_y)) {
+		type = chunk_y >= 1 ? chunk_t::AIR : chunk_t::GRASS;
+		return true;
+	}
+	// local heights span [chunk_y, chunk_y + 63/64]
+	const float lo = (float)chunk_y;
+	const float hi = (float)chunk_y + (float)(CHUNK_SIZE - 1) / (float)CHUNK_SIZE;
+	if (lo > max_elevation) {
+		type = lo >= 0.f ? chunk_t::AIR : chunk_t::WATER;
+		return true;
+	}
+	if (hi <= min_elevation) {
+		type = chunk_t::GRASS;
+		return true;
+	}
+	return false;
+}
 
-	bool is_outside_range = coordinate.y >= 1 || coordinate.y < -1;
-	glm::ivec3 tex_coord = (int)CHUNK_SIZE * coordinate;
+static const float* elevation_at(const heightmap_t* heightmap, int x, int z)
+{
+	return heightmap ? heightmap->at(x, z) : nullptr;
+}
 
-	HastyNoise::FloatBuffer texture;
-	{
-		ZoneScoped("noise_gen");
-		map->noise->SetNoiseType(HastyNoise::NoiseType::Simplex);
-		map->noise->SetFrequency(0.05f);
-		if (!is_outside_range)
-			texture = map->noise->GetNoiseSet(tex_coord.x, tex_coord.z, tex_coord.y, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+// classify the slices of the six neighbouring chunks that touch this one straight from
+// the terrain, so boundary faces can be culled without waiting for the neighbours to load
+static void generate_border(const glm::ivec3& coordinate, const heightmap_t* heightmap, chunk_border_t& border)
+{
+	const int N = CHUNK_SIZE;
+	for (int a = 0; a < N; a++) {
+		for (int b = 0; b < N; b++) {
+			const size_t idx = a * CHUNK_1 + b;
+			border.blocks[0][idx] = classify_block(coordinate.y, b, elevation_at(heightmap, N, a));
+			border.blocks[3][idx] = classify_block(coordinate.y, b, elevation_at(heightmap, -1, a));
+			border.blocks[2][idx] = classify_block(coordinate.y, b, elevation_at(heightmap, a, N));
+			border.blocks[5][idx] = classify_block(coordinate.y, b, elevation_at(heightmap, a, -1));
+			border.blocks[1][idx] = classify_block(coordinate.y + 1, 0, elevation_at(heightmap, a, b));
+			border.blocks[4][idx] = classify_block(coordinate.y - 1, N - 1, elevation_at(heightmap, a, b));
+		}
 	}
+}
+
+// fractal terrain of one column of chunks, turned into elevation. runs on a loader worker
+static void generate_heightmap(map_system_t* map, size_t worker, const glm::ivec2& column, heightmap_t& out)
+{
+	const glm::ivec2 tex_coord = (int)CHUNK_SIZE * column;
+	const int N = (int)heightmap_t::SIZE_1;
 
 	HastyNoise::FloatBuffer terrain;
 	{
 		ZoneScoped("terrain_gen");
-		map->noise->SetNoiseType(HastyNoise::NoiseType::SimplexFractal);
-		map->noise->SetFractalOctaves(5);
-		map->noise->SetFrequency(0.0025f);
-		if (!is_outside_range)
-			terrain = map->noise->GetNoiseSet(tex_coord.x, tex_coord.z, 0, CHUNK_SIZE, CHUNK_SIZE, 1);
+		terrain = map->noise[worker].terrain->GetNoiseSet(tex_coord.x - 1, tex_coord.y - 1, 0, N, N, 1);
 	}
 
-	float* buffer = texture.get();
-	int* blocks = new int[CHUNK_3];
+	out.min_elevation = INFINITY;
+	out.max_elevation = -INFINITY;
+	for (int x = -1; x < CHUNK_SIZE + 1; x++) {
+		for (int z = -1; z < CHUNK_SIZE + 1; z++) {
+			const size_t idx = (x + 1) * N + (z + 1);
+			const float e = terrain_elevation(terrain.get()[idx]);
+			out.elevation[idx] = e;
+			if (x >= 0 && x < CHUNK_SIZE && z >= 0 && z < CHUNK_SIZE) {
+				out.min_elevation = std::min(out.min_elevation, e);
+				out.max_elevation = std::max(out.max_elevation, e);
+			}
+		}
+	}
+}
 
-	for (size_t x = 0; x < CHUNK_SIZE; x++) {
-		for (size_t z = 0; z < CHUNK_SIZE; z++) {
-			for (size_t y = 0; y < CHUNK_SIZE; y++) {
-				const size_t idx = x * CHUNK_2 + z * CHUNK_1 + y;
-				const size_t terrain_idx = x * CHUNK_1 + z;
-				const float test = (float)coordinate.y + (float)y / (float)CHUNK_SIZE;
+// heightmap under `coordinate`, or null if neither the chunk nor (for face culling)
+// the chunks right above and below it reach the generated range
+static heightmap_cache_t::handle_t chunk_heightmap(map_system_t* map, size_t worker, const glm::ivec3& coordinate)
+{
+	const bool faces = map->mesh_mode == map_system_t::MESH_FACES;
+	const bool needs_terrain = !is_outside_range(coordinate.y)
+		|| (faces && (!is_outside_range(coordinate.y + 1) || !is_outside_range(coordinate.y - 1)));
+	if (!needs_terrain)
+		return nullptr;
+	return map->heightmaps.get({ coordinate.x, coordinate.z }, [map, worker](const glm::ivec2& column, heightmap_t& out) {
+		generate_heightmap(map, worker, column, out);
+	});
+}
 
-				if (is_outside_range) {
-					blocks[idx] = test > 0 ? chunk_t::AIR : chunk_t::GRASS;
-					continue;
-				}
+// let the faces towards neighbours at another level of detail through
+static void open_seams(uint8_t seams, chunk_border_t& border)
+{
+	for (unsigned dir = 0; dir < 6; dir++) {
+		if (seams & (1u << dir))
+			std::memset(border.blocks[dir], chunk_t::AIR, CHUNK_2);
+	}
+}
 
-				const float terrain_val = terrain.get()[terrain_idx];
-				const float terrain_sign = terrain_val == 0.f ? 1.f : terrain_val / std::fabs(terrain_val);
-				const float elevation = 1.5f * terrain_sign * std::pow(std::fabs(terrain_val), 1.9f) + 0.2f;// +0.5f;
-				if (test > elevation) {
-					if (test >= 0.f) {
-						blocks[idx] = chunk_t::AIR;
-					} else {
-						blocks[idx] = chunk_t::WATER;
-					}
-				} else {
-					blocks[idx] = chunk_t::GRASS;
-				}
-			}
+template<typename T>
+static void scale_boxes(std::vector<T>& boxes, unsigned scale)
+{
+	for (T& b : boxes) {
+		b.x *= scale; b.y *= scale; b.z *= scale;
+		b.w *= scale; b.h *= scale; b.d *= scale;
+	}
+}
+
+// halve the blocks `lod` times, mesh the small cube and scale the result back up. coarse
+// meshes keep all their boundary faces, which also closes the seams with finer neighbours
+static void mesh_blocks_lod(map_system_t* map, int lod, const block_t* blocks, uint32_t materials, chunk_result_t& result)
+{
+	ZoneScoped;
+
+	static thread_local std::vector<block_t> levels[map_system_t::MAX_LOD];
+	const block_t* src = blocks;
+	size_t size = CHUNK_1;
+	for (int l = 0; l < lod; l++) {
+		levels[l].resize((size / 2) * (size / 2) * (size / 2));
+		downsample_blocks(src, size, levels[l].data());
+		src = levels[l].data();
+		size /= 2;
+	}
+
+	const unsigned scale = 1u << lod;
+	if (map->mesh_mode == map_system_t::MESH_FACES) {
+		static thread_local chunk_border_t open_border;
+		open_seams(0x3f, open_border);
+		std::vector<face_t> quads[chunk_t::_COUNT];
+		blocks_to_faces_materials(src, open_border, chunk_t::_COUNT, 1u << chunk_t::WATER, quads, size, materials);
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			scale_boxes(quads[j], scale);
+			generate_face_mesh(quads[j], j, result.vertices[j]);
+		}
+	} else {
+		std::vector<quad_t> quads[chunk_t::_COUNT];
+		blocks_to_mesh_materials(src, chunk_t::_COUNT, quads, size, materials);
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			scale_boxes(quads[j], scale);
+			generate_quad_mesh(quads[j], j, result.vertices[j], result.indices[j]);
 		}
 	}
+}
 
-	{
+// mesh the `materials` of `volume` into `result` at level `lod`; `blocks` is its dense form, or
+// null if the volume is uniform. `border` (faces mode only) has the neighbouring blocks, seams included
+static void mesh_volume(map_system_t* map, int lod, const chunk_border_t& border, const chunk_volume_t& volume, const block_t* blocks, uint32_t materials, chunk_result_t& result)
+{
+	const bool faces = map->mesh_mode == map_system_t::MESH_FACES;
+
+	// a single block type already meshes to a handful of boxes, whatever the level
+	if (volume.is_uniform()) {
+		ZoneScoped("uniform_chunk");
+		const block_t uniform = volume.uniform_value();
+		if (uniform >= chunk_t::_COUNT || !(materials & (1u << uniform)))
+			return;
+		if (faces) {
+			std::vector<face_t> quads[chunk_t::_COUNT];
+			uniform_to_faces_materials(uniform, border, chunk_t::_COUNT, 1u << chunk_t::WATER, quads);
+			generate_face_mesh(quads[uniform], uniform, result.vertices[uniform]);
+		} else {
+			const std::vector<quad_t> box = { { 0, 0, 0, CHUNK_1, CHUNK_1, CHUNK_1 } };
+			generate_quad_mesh(box, uniform, result.vertices[uniform], result.indices[uniform]);
+		}
+		return;
+	}
+
+	if (lod > 0) {
+		mesh_blocks_lod(map, lod, blocks, materials, result);
+		return;
+	}
+
+	if (faces) {
+		ZoneScoped("face_mesh");
+		std::vector<face_t> quads[chunk_t::_COUNT];
+		blocks_to_faces_materials(blocks, border, chunk_t::_COUNT, 1u << chunk_t::WATER, quads, CHUNK_SIZE, materials);
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			generate_face_mesh(quads[j], j, result.vertices[j]);
+		}
+	} else {
 		ZoneScoped("greedy_mesh");
-		std::vector<quad_t> quads;
+		std::vector<quad_t> quads[chunk_t::_COUNT];
+		blocks_to_mesh_materials(blocks, chunk_t::_COUNT, quads, CHUNK_SIZE, materials);
 		for (int j = 0; j < chunk_t::_COUNT; j++) {
-			quads = blocks_to_mesh_greedy(blocks, j);
-			generate_quad_mesh(map, chunk.meshes[j], quads, j);
+			generate_quad_mesh(quads[j], j, result.vertices[j], result.indices[j]);
+		}
+	}
+}
+
+// mesh all of `volume` into `result` as asked by `job`, against the generated terrain around it
+// (or the loaded neighbours the job carries)
+static void mesh_chunk(map_system_t* map, const chunk_job_t& job, const heightmap_t* heightmap, const chunk_volume_t& volume, const block_t* blocks, chunk_result_t& result)
+{
+	static thread_local chunk_border_t border;
+	if (map->mesh_mode == map_system_t::MESH_FACES) {
+		generate_border(job.coord, heightmap, border);
+		for (unsigned dir = 0; dir < 6; dir++) {
+			if (job.border_dirs & (1u << dir))
+				std::memcpy(border.blocks[dir], job.border->blocks[dir], CHUNK_2);
 		}
+		open_seams(job.seams, border);
 	}
+	mesh_volume(map, job.lod, border, volume, blocks, ~0u, result);
+}
 
-	delete[] blocks;
+// only full-detail meshes without seams are worth saving: anything else depends on where the camera is
+static bool storable_meshes(const chunk_job_t& job)
+{
+	return job.lod == 0 && job.seams == 0;
+}
+
+// saved chunks are only remeshed if the store has no meshes for the current mode
+static bool load_stored_chunk(map_system_t* map, size_t worker, const chunk_job_t& job, chunk_result_t& result)
+{
+	ZoneScoped;
+
+	const glm::ivec3& coordinate = job.coord;
+	bool has_meshes = false;
+	if (!map->store.load(coordinate, map->mesh_mode, result, has_meshes))
+		return false;
+	if (has_meshes && storable_meshes(job))
+		return true;
+	for (int j = 0; j < chunk_t::_COUNT; j++) {
+		result.vertices[j].clear();
+		result.indices[j].clear();
+	}
+
+	heightmap_cache_t::handle_t heightmap = chunk_heightmap(map, worker, coordinate);
+	static thread_local block_t blocks[CHUNK_3];
+	if (!result.volume.is_uniform())
+		result.volume.decompress(blocks);
+	mesh_chunk(map, job, heightmap.get(), result.volume, blocks, result);
+	if (map->store_mode == map_system_t::STORE_MESHES && !has_meshes && storable_meshes(job))
+		map->store.save(coordinate, result, map->mesh_mode);
+	return true;
+}
+
+// runs on a loader worker: must only read `map` (besides its locked caches and store), never touch the asset or entity managers
+static void generate_chunk(map_system_t *map, size_t worker, const chunk_job_t& job, chunk_result_t& result)
+{
+	ZoneScoped;
+
+	const glm::ivec3 coordinate = job.coord;
+	// dense scratch for classification and meshing; the chunk keeps the compressed copy
+	static thread_local block_t blocks[CHUNK_3];
+
+	if (job.source) {
+		heightmap_cache_t::handle_t heightmap = chunk_heightmap(map, worker, coordinate);
+		if (!job.source->is_uniform())
+			job.source->decompress(blocks);
+		mesh_chunk(map, job, heightmap.get(), *job.source, blocks, result);
+		return;
+	}
+
+	if (map->store_mode != map_system_t::STORE_OFF && load_stored_chunk(map, worker, job, result))
+		return;
+
+	heightmap_cache_t::handle_t heightmap = chunk_heightmap(map, worker, coordinate);
+
+	float min_elevation = 0.f, max_elevation = 0.f;
+	if (!is_outside_range(coordinate.y)) {
+		min_elevation = heightmap->min_elevation;
+		max_elevation = heightmap->max_elevation;
+	}
+	block_t uniform;
+	const bool is_uniform = classify_uniform(coordinate.y, min_elevation, max_elevation, uniform);
+
+	if (is_uniform) {
+		result.volume.fill(uniform);
+	} else {
+		classify_chunk(coordinate.y, *heightmap, blocks);
+		result.volume.compress(blocks);
+	}
+	mesh_chunk(map, job, heightmap.get(), result.volume, blocks, result);
+
+	if (map->store_mode != map_system_t::STORE_OFF) {
+		const bool meshes = map->store_mode == map_system_t::STORE_MESHES && storable_meshes(job);
+		map->store.save(coordinate, result, meshes ? map->mesh_mode : -1);
+	}
 }
 
 static uint32_t generate_seed()
@@ -288,90 +519,550 @@ static glm::ivec3 get_chunk_pos(glm::vec3 world_pos)
 	return pos;
 }
 
-static void load_chunks(map_system_t* map, std::vector<glm::ivec3>& to_load)
+static bool in_view(const map_system_t* map, const glm::ivec3& coord)
 {
-	ZoneScoped;
+	const glm::ivec3 dist = glm::abs(coord - map->chunk_coord);
+	const int vdist = static_cast<int>(map->view_distance);
+	return dist.x <= vdist && dist.y <= vdist && dist.z <= vdist;
+}
 
-	{
-		ZoneScoped("cache_sort");
-		static const auto sort_by_distance = [map](glm::ivec3& a, glm::ivec3& b) -> bool {
-			glm::vec3 aa(a); glm::vec3 bb(b);
-			glm::vec3 pos(map->chunk_coord);
-			return glm::distance(pos, aa) < glm::distance(pos, bb);
-		};
-		std::sort(map->chunk_cache_sorted.begin(), map->chunk_cache_sorted.end(), sort_by_distance);
+static void submit_model(map_system_t* map, chunk_t& chunk, bool visible)
+{
+	RenderModel model;
+	std::memcpy(model.meshes, chunk.meshes, chunk_t::_COUNT * sizeof(asset_t));
+	model.num_meshes = chunk_t::_COUNT;
+	map->model_clock = std::max(SDL_GetTicks(), map->model_clock + 1);
+	model.last_update = map->model_clock;
+	model.visible = visible;
+	map->ctx->emgr.insert_component<RenderModel>(chunk.entity, model);
+	chunk.has_model = true;
+}
+
+// resubmit the model only if its visibility actually changes
+static void set_visible(map_system_t* map, chunk_t& chunk, bool visible)
+{
+	if (!chunk.loaded || !chunk.has_model)
+		return;
+	const RenderModel& rm = map->ctx->emgr.get_component<RenderModel>(chunk.entity);
+	if (rm.visible != visible)
+		submit_model(map, chunk, visible);
+}
+
+// calls `fn` for every coordinate of the view box around `center` that is not in the
+// view box around `other`. work is proportional to the result (a slab when the camera
+// moves by one chunk), plus one test per row of the box
+template<typename F>
+static void view_box_difference(const glm::ivec3& center, const glm::ivec3& other, int vdist, F fn)
+{
+	const glm::ivec3 lo = center - vdist, hi = center + vdist;
+	const glm::ivec3 other_lo = other - vdist, other_hi = other + vdist;
+	for (int x = lo.x; x <= hi.x; x++) {
+		const bool x_in = x >= other_lo.x && x <= other_hi.x;
+		for (int y = lo.y; y <= hi.y; y++) {
+			const bool y_in = x_in && y >= other_lo.y && y <= other_hi.y;
+			if (!y_in) {
+				for (int z = lo.z; z <= hi.z; z++)
+					fn(glm::ivec3(x, y, z));
+				continue;
+			}
+			// only the parts of the row outside [other_lo.z, other_hi.z]
+			for (int z = lo.z; z <= hi.z && z < other_lo.z; z++)
+				fn(glm::ivec3(x, y, z));
+			for (int z = std::max(lo.z, other_hi.z + 1); z <= hi.z; z++)
+				fn(glm::ivec3(x, y, z));
+		}
+	}
+}
+
+// chunks within this many chunks of the camera go first regardless of direction
+static const float NEAR_CHUNKS = 1.75f;
+// extra distance, in chunks, per unit of cosine outside the view cone
+static const float OFF_VIEW_PENALTY = 16.f;
+
+// load order: chunks around the camera, then chunks inside the view cone by distance,
+// then everything else by distance plus a penalty that grows with the angle off the view
+static float job_priority(const map_system_t* map, const glm::ivec3& coord)
+{
+	const glm::vec3 d = glm::vec3(coord - map->chunk_coord);
+	const float dist = glm::length(d);
+	if (dist < NEAR_CHUNKS)
+		return dist;
+	const float facing = glm::dot(d / dist, map->look);
+	if (facing >= map->cos_view)
+		return dist;
+	return dist + (map->cos_view - facing) * OFF_VIEW_PENALTY;
+}
+
+// level of detail for a chunk: how many of `lod_rings` it lies beyond
+static uint8_t chunk_lod(const map_system_t* map, const glm::ivec3& coord)
+{
+	const glm::ivec3 d = glm::abs(coord - map->chunk_coord);
+	const int dist = std::max(d.x, std::max(d.y, d.z));
+	uint8_t lod = 0;
+	while (lod < map_system_t::MAX_LOD && dist > map->lod_rings[lod])
+		lod++;
+	return lod;
+}
+
+// level of detail and seams the meshes of a chunk should have right now. only full-detail
+// face meshes cull against their neighbours, so they are the only ones with seams to open
+static void desired_mesh(const map_system_t* map, const glm::ivec3& coord, uint8_t& lod, uint8_t& seams)
+{
+	lod = chunk_lod(map, coord);
+	seams = 0;
+	if (lod != 0 || map->mesh_mode != map_system_t::MESH_FACES)
+		return;
+	for (unsigned dir = 0; dir < 6; dir++) {
+		if (chunk_lod(map, coord + glm::ivec3(normals[dir])) != lod)
+			seams |= 1u << dir;
+	}
+}
+
+// marks meshes that have to be rebuilt whatever the camera does, e.g. after their job was cancelled
+static const uint8_t LOD_STALE = 0xff;
+
+// the side of a neighbour's volume that touches the chunk in direction `dir` from it,
+// laid out as in `generate_border`
+static void border_slice(const chunk_volume_t& volume, unsigned dir, block_t* out)
+{
+	const size_t N = CHUNK_1;
+	if (volume.is_uniform()) {
+		std::memset(out, volume.uniform_value(), CHUNK_2);
+		return;
+	}
+	for (size_t a = 0; a < N; a++) {
+		for (size_t b = 0; b < N; b++) {
+			switch (dir) {
+			case 0: out[a * N + b] = volume.get(0, b, a); break;
+			case 3: out[a * N + b] = volume.get(N - 1, b, a); break;
+			case 2: out[a * N + b] = volume.get(a, b, 0); break;
+			case 5: out[a * N + b] = volume.get(a, b, N - 1); break;
+			case 1: out[a * N + b] = volume.get(a, 0, b); break;
+			case 4: out[a * N + b] = volume.get(a, N - 1, b); break;
+			}
+		}
+	}
+}
+
+// the blocks around a loaded chunk, taken from its loaded neighbours (AIR where there are none)
+static void volume_border(map_system_t* map, const glm::ivec3& coord, chunk_border_t& border)
+{
+	for (unsigned dir = 0; dir < 6; dir++) {
+		const uint32_t slot = map->chunk_cache.find(coord + glm::ivec3(normals[dir]));
+		if (slot == NO_CHUNK || !map->chunk_cache[slot].loaded)
+			std::memset(border.blocks[dir], chunk_t::AIR, CHUNK_2);
+		else
+			border_slice(map->chunk_cache[slot].volume, dir, border.blocks[dir]);
+	}
+}
+
+// hand a job the sides of the loaded neighbours of its chunk, which may have been edited (now
+// or in a past session); the worker generates the others from the terrain. only full-detail
+// face meshes look at the border
+static void snapshot_border(map_system_t* map, chunk_job_t& job)
+{
+	job.border_dirs = 0;
+	if (map->mesh_mode != map_system_t::MESH_FACES || job.lod != 0)
+		return;
+	std::shared_ptr<chunk_border_t> border;
+	for (unsigned dir = 0; dir < 6; dir++) {
+		const uint32_t slot = map->chunk_cache.find(job.coord + glm::ivec3(normals[dir]));
+		if (slot == NO_CHUNK || !map->chunk_cache[slot].loaded)
+			continue;
+		if (!border)
+			border = std::make_shared<chunk_border_t>();
+		border_slice(map->chunk_cache[slot].volume, dir, border->blocks[dir]);
+		job.border_dirs |= 1u << dir;
+	}
+	job.border = border;
+}
+
+static void queue_chunk(map_system_t* map, chunk_t& ch, bool prefetch)
+{
+	ch.queued = true;
+	desired_mesh(map, ch.coord, ch.lod, ch.seams);
+	chunk_job_t job = { ch.coord, ch.ticket, job_priority(map, ch.coord), prefetch, ch.lod, ch.seams };
+	snapshot_border(map, job);
+	map->loader.push(job);
+}
+
+// rebuild the meshes of a loaded chunk if its level of detail or seams changed. the old
+// meshes stay up until the new ones arrive, so these jobs go after any missing chunk
+static void remesh_chunk(map_system_t* map, uint32_t slot)
+{
+	chunk_t& ch = map->chunk_cache[slot];
+	if (!ch.loaded || ch.queued)
+		return;
+	uint8_t lod, seams;
+	desired_mesh(map, ch.coord, lod, seams);
+	if (lod == ch.lod && seams == ch.seams)
+		return;
+
+	ch.ticket = ++map->ticket;
+	ch.queued = true;
+	ch.lod = lod;
+	ch.seams = seams;
+	const float priority = job_priority(map, ch.coord) + static_cast<float>(map->view_distance);
+	chunk_job_t job = { ch.coord, ch.ticket, priority, false, lod, seams, std::make_shared<chunk_volume_t>(ch.volume) };
+	snapshot_border(map, job);
+	map->loader.push(job);
+}
+
+// write the blocks of an edited chunk to the store, so that it comes back with its edits
+static void save_edited(map_system_t* map, const chunk_t& ch)
+{
+	chunk_result_t saved;
+	saved.volume = ch.volume;
+	map->store.save(ch.coord, saved, -1);
+}
+
+// slot for a chunk at `coord` that isn't cached yet, with a new ticket: either an old
+// chunk out of view is recycled (if over budget) or a fresh one is made
+static uint32_t acquire_chunk(map_system_t* map, const glm::ivec3& coord)
+{
+	uint32_t slot = map->residency.over_budget() ? map->residency.victim(map->chunk_coord, (int)map->view_distance) : NO_CHUNK;
+	if (slot != NO_CHUNK) {
+		if (map->chunk_cache[slot].edited)
+			save_edited(map, map->chunk_cache[slot]);
+		map->chunk_cache.rekey(slot, coord);
+		chunk_t& ch = map->chunk_cache[slot];
+		ch.edited = false;
+		// hide the evicted geometry until the new meshes arrive
+		if (ch.has_model)
+			submit_model(map, ch, false);
+		ch.volume.fill(chunk_t::AIR);
+		if (ch.prefetched)
+			map->prefetch_wasted++;
+		map->residency.touch(slot);
+	} else {
+		chunk_t fresh;
+		map->ctx->emgr.new_entity(&fresh.entity, 1);
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			IndexedMesh* mesh = map->ctx->assets.create<IndexedMesh>(&fresh.meshes[j], asset_manager_t::CHUNK_MESHES);
+			mesh->vertices = nullptr;
+			mesh->indices = nullptr;
+			mesh->num_indices = 0;
+			mesh->num_verts = 0;
+		}
+		fresh.has_model = false;
+		fresh.edited = false;
+		fresh.bytes = sizeof(chunk_t);
+		fresh.coord = coord;
+		slot = map->chunk_cache.insert(fresh);
+		map->residency.insert(slot);
 	}
+	chunk_t& ch = map->chunk_cache[slot];
+	ch.ticket = ++map->ticket;
+	ch.loaded = false;
+	ch.queued = false;
+	ch.prefetched = false;
+	ch.dirty = 0;
+	return slot;
+}
 
+static void load_chunks(map_system_t* map, std::vector<glm::ivec3>& to_load)
+{
+	ZoneScoped;
 
 	// load chunk coordinates, ignore hot chunks
-	const size_t view_on_flight = (2 * map->view_distance + 1) * (2 * map->view_distance + 1) * (2 * map->view_distance + 1);
-	std::vector<std::pair<glm::ivec3, chunk_t>> for_real;
-	std::stringstream ss;
-	static uint32_t base = 0;
+	std::vector<uint32_t> requested;
 	{
 		ZoneScoped("chunk_prepare");
 		for (int i = 0; i < to_load.size(); i++) {
-			glm::ivec3 chunk = to_load[i];
-			chunk_t ch;
-			if (map->chunk_cache.find(chunk) != map->chunk_cache.end())
-				continue;
-			// this is the max cache size we're willing to deal with
-			// TODO should depend on the view distance, but how exactly?????
-			if (map->chunk_cache_sorted.size() > view_on_flight * 2) {
-				glm::ivec3 target = map->chunk_cache_sorted.back();
-				map->chunk_cache_sorted.pop_back();
-				auto nh = map->chunk_cache.extract(target);
-				ch = nh.mapped();
-				nh.key() = chunk;
-				map->chunk_cache.insert(std::move(nh));
-			} else {
-				map->ctx->emgr.new_entity(&ch.entity, 1);
-				for (int j = 0; j < chunk_t::_COUNT; j++) {
-					ss.str(std::string());
-					ss.clear();
-					ss << "ChunkMesh" << base++;
-					ch.meshes[j] = hash_str(ss.str());
-					IndexedMesh* mesh = map->ctx->assets.make<IndexedMesh>(ch.meshes[j]);
-					mesh->vertices = nullptr;
-					mesh->indices = nullptr;
-					mesh->num_indices = 0;
-					mesh->num_verts = 0;
+			glm::ivec3 coord = to_load[i];
+			uint32_t slot = map->chunk_cache.find(coord);
+			if (slot != NO_CHUNK) {
+				chunk_t& ch = map->chunk_cache[slot];
+				if (ch.prefetched) {
+					// came into view: if its job hasn't started yet, it can't wait behind spare work
+					ch.prefetched = false;
+					if (ch.loaded || ch.queued)
+						map->prefetch_hits++;
+					if (ch.queued)
+						map->loader.promote(ch.ticket, job_priority(map, coord));
+				}
+				map->residency.touch(slot);
+				if (!ch.loaded && !ch.queued) {
+					// its job was cancelled when it went out of view
+					ch.ticket = ++map->ticket;
+					requested.push_back(slot);
+					continue;
 				}
-				map->chunk_cache.insert({ chunk, ch });
+				// back in view: show it again, at the level of detail for where it is now
+				set_visible(map, ch, in_view(map, coord));
+				remesh_chunk(map, slot);
+				continue;
+			}
+			requested.push_back(acquire_chunk(map, coord));
+		}
+	}
+
+	// generate chunks in the background; results are picked up by `finish_chunks`
+	for (uint32_t slot : requested)
+		queue_chunk(map, map->chunk_cache[slot], false);
+}
+
+// pick up at most `chunks_per_frame` finished chunks and hand them to the renderer
+static void finish_chunks(map_system_t* map)
+{
+	ZoneScoped;
+
+	static std::vector<chunk_result_t> results;
+	results.clear();
+	map->loader.drain(results, map->chunks_per_frame);
+
+	for (chunk_result_t& res : results) {
+		const uint32_t slot = map->chunk_cache.find(res.coord);
+		// chunk was evicted (and maybe recycled) while the job was in flight
+		if (slot == NO_CHUNK || map->chunk_cache[slot].ticket != res.ticket)
+			continue;
+
+		chunk_t& chunk = map->chunk_cache[slot];
+		chunk.queued = false;
+		size_t bytes = sizeof(chunk_t);
+		for (int j = 0; j < chunk_t::_COUNT; j++)
+			bytes += upload_mesh(map, chunk.meshes[j], res.vertices[j], res.indices[j]);
+		if (!res.remeshed) {
+			chunk.volume = std::move(res.volume);
+			chunk.volume.occupancy(chunk_t::AIR, chunk.bricks);
+		}
+		map->residency.set_bytes(slot, bytes + chunk.volume.bytes());
+		chunk.loaded = true;
+
+		const bool visible = in_view(map, res.coord);
+		submit_model(map, chunk, visible);
+		if (!visible)
+			map->shed_scan = true;
+		if (!res.remeshed)
+			map->ctx->emgr.insert_component<Position>(chunk.entity, { (float)CHUNK_SIZE * glm::vec3(res.coord) });
+		// the camera may have crossed a ring while the job ran
+		remesh_chunk(map, slot);
+	}
+}
+
+// how far (cosine of the angle) the camera must turn before queued jobs are re-prioritized
+static const float REPRIORITIZE_TURN = 0.985f;
+
+// re-order queued jobs for the current camera, and drop the ones that aren't needed anymore:
+// regular jobs out of view, prefetch jobs that the camera has moved well away from
+static void reprioritize_jobs(map_system_t* map, bool moved)
+{
+	if (!moved && glm::dot(map->look, map->prioritized_look) > REPRIORITIZE_TURN)
+		return;
+	ZoneScoped;
+	map->prioritized_look = map->look;
+
+	const int vdist = static_cast<int>(map->view_distance);
+	std::vector<chunk_job_t> cancelled;
+	map->loader.reprioritize([map, vdist](const chunk_job_t& job) -> float {
+		const glm::ivec3 d = glm::abs(job.coord - map->chunk_coord);
+		const int dist = std::max(d.x, std::max(d.y, d.z));
+		if (dist > (job.prefetch ? 2 * vdist : vdist))
+			return -1.f;
+		return job_priority(map, job.coord);
+	}, cancelled);
+
+	// back to unloaded: load_chunks queues them again if they come back into view.
+	// loaded chunks keep their old meshes, which no longer match `lod` and `seams`
+	for (const chunk_job_t& job : cancelled) {
+		const uint32_t slot = map->chunk_cache.find(job.coord);
+		if (slot == NO_CHUNK || map->chunk_cache[slot].ticket != job.ticket)
+			continue;
+		chunk_t& ch = map->chunk_cache[slot];
+		ch.queued = false;
+		if (ch.loaded)
+			ch.lod = LOD_STALE;
+	}
+}
+
+// calls `fn` for every chunk at exactly Chebyshev distance `dist` from `center`
+template<typename F>
+static void view_shell(const glm::ivec3& center, int dist, F fn)
+{
+	if (dist == 0) {
+		fn(center);
+		return;
+	}
+	for (int x = -dist; x <= dist; x++) {
+		for (int y = -dist; y <= dist; y++) {
+			// the two z faces of the shell are full, elsewhere only its z edges
+			const bool face = x == -dist || x == dist || y == -dist || y == dist;
+			for (int z = -dist; z <= dist; z += face ? 1 : 2 * dist) {
+				fn(center + glm::ivec3(x, y, z));
 			}
-			for_real.push_back({ chunk, ch });
 		}
 	}
+}
 
-	// generate chunks (heavy lifting -- go wide)
-	// TODO: this is temporary, we will eventually want to be more systematic about splitting
-	//  the chunk-generating workload.
-	//  it's probably a good idea to avoid such spiked work (we're idling most of the time except
-	//   when we're loading chunks) and have background threads loading nearby chunks into the cache.
-	//   then, walking around would be seamless. only flying really fast is an issue.
-	//  at any rate, simply decoupling this work from the main render thread would be progress; allowing
-	//   other systems to do their work, and joining right before we materialize the frame changes.
-	// TODO2: this is thread unsafe -- we are allocating stuff from the asset manager,
-	//        which right now has no locking.
-	// ANSWER: this is in fact thread safe --- each thread touches the memory blocks of a given number of assets,
-	//         and they never insert/remove from the outermost map in the asset manager. so it's ok.
-#pragma omp parallel for num_threads(4)
-	for (int i = 0; i < for_real.size(); i++) {
-		generate_chunk(map, for_real[i].second, for_real[i].first);
-	}
-
-	// insert chunk components and refill cache vector
-	for (int i = 0; i < for_real.size(); i++) {
-		const chunk_t& chunk = for_real[i].second;
-		const glm::ivec3& chunk_coord = for_real[i].first;
-		map->chunk_cache_sorted.push_back(chunk_coord);
-		RenderModel model;
-		std::memcpy(model.meshes, chunk.meshes, chunk_t::_COUNT * sizeof(asset_t));
-		model.num_meshes = chunk_t::_COUNT;
-		model.last_update = SDL_GetTicks();
-		model.visible = true;
-		map->ctx->emgr.insert_component<RenderModel>(chunk.entity, model);
-		map->ctx->emgr.insert_component<Position>(chunk.entity, { (float)CHUNK_SIZE * glm::vec3(chunk_coord) });
+// after the camera moved from `old_center`, remesh the chunks whose level of detail or seams
+// changed. for a step of one chunk those all lie next to a ring, so only those shells are visited
+static void update_lods(map_system_t* map, const glm::ivec3& old_center)
+{
+	ZoneScoped;
+
+	const int vdist = static_cast<int>(map->view_distance);
+	auto visit = [map](const glm::ivec3& coord) {
+		const uint32_t slot = map->chunk_cache.find(coord);
+		if (slot != NO_CHUNK)
+			remesh_chunk(map, slot);
+	};
+
+	const glm::ivec3 step = glm::abs(map->chunk_coord - old_center);
+	if (std::max(step.x, std::max(step.y, step.z)) > 1) {
+		for (int dist = 0; dist <= vdist; dist++)
+			view_shell(map->chunk_coord, dist, visit);
+		return;
+	}
+	for (int i = 0; i < map_system_t::MAX_LOD; i++) {
+		const int ring = map->lod_rings[i];
+		for (int dist = std::max(ring - 1, 0); dist <= std::min(ring + 2, vdist); dist++)
+			view_shell(map->chunk_coord, dist, visit);
+	}
+}
+
+// how long to wait for the remeshes of a changed level of detail before changing it again
+static const uint32_t LOD_SHED_MS = 2000;
+// the rings are let out again once chunk meshes use less than this part of the budget
+static const float LOD_RESTORE_USAGE = 0.8f;
+
+static void remesh_view(map_system_t* map)
+{
+	for (int dist = 0; dist <= static_cast<int>(map->view_distance); dist++) {
+		view_shell(map->chunk_coord, dist, [map](const glm::ivec3& coord) {
+			const uint32_t slot = map->chunk_cache.find(coord);
+			if (slot != NO_CHUNK)
+				remesh_chunk(map, slot);
+		});
+	}
+}
+
+// free the mesh memory of a loaded chunk; it is remeshed from its volume if it comes back into view
+static size_t drop_meshes(map_system_t* map, uint32_t slot)
+{
+	chunk_t& ch = map->chunk_cache[slot];
+	size_t freed = 0;
+	for (int j = 0; j < chunk_t::_COUNT; j++) {
+		const asset_t a = ch.meshes[j];
+		auto mesh = map->ctx->assets.get<IndexedMesh>(a);
+		freed += mesh_bytes(map, a);
+		map->ctx->assets.free_chunk(a, (uint8_t*)mesh->vertices);
+		map->ctx->assets.free_chunk(a, (uint8_t*)mesh->indices);
+		mesh->vertices = nullptr;
+		mesh->indices = nullptr;
+		mesh->num_verts = 0;
+		mesh->num_indices = 0;
+	}
+	if (ch.has_model)
+		submit_model(map, ch, false);
+	ch.lod = LOD_STALE;
+	map->residency.set_bytes(slot, chunk_bytes(map, ch));
+	return freed;
+}
+
+// chunk meshes are `over` bytes over budget: drop the meshes of the farthest chunks out of
+// view first. if that isn't enough, pull the level of detail rings in by one chunk and remesh
+static void shed_meshes(map_system_t* map, size_t over)
+{
+	ZoneScoped;
+
+	std::vector<std::pair<int, uint32_t>> idle;
+	for (uint32_t slot = 0; map->shed_scan && slot < map->chunk_cache.size(); slot++) {
+		const chunk_t& ch = map->chunk_cache[slot];
+		if (!ch.loaded || ch.queued || ch.dirty || ch.lod == LOD_STALE || in_view(map, ch.coord))
+			continue;
+		const glm::ivec3 d = glm::abs(ch.coord - map->chunk_coord);
+		idle.push_back({ std::max(d.x, std::max(d.y, d.z)), slot });
+	}
+	std::sort(idle.begin(), idle.end(), std::greater<std::pair<int, uint32_t>>());
+
+	size_t freed = 0;
+	size_t i = 0;
+	for (; i < idle.size() && freed < over; i++) {
+		freed += drop_meshes(map, idle[i].second);
+		map->meshes_dropped++;
+	}
+	// if all were dropped, there is nothing to scan for until chunks leave view again
+	map->shed_scan = i < idle.size();
+	if (freed >= over)
+		return;
+
+	const uint32_t now = SDL_GetTicks();
+	if (map->lod_rings[map_system_t::MAX_LOD - 1] == 0 || now - map->lod_shed_at < LOD_SHED_MS)
+		return;
+	map->lod_shed_at = now;
+	for (int j = 0; j < map_system_t::MAX_LOD; j++)
+		map->lod_rings[j] = std::max(map->lod_rings[j] - 1, 0);
+	std::printf("[map] over mesh budget by %zu kB, lod_rings=%d,%d,%d\n", (over - freed) >> 10,
+		map->lod_rings[0], map->lod_rings[1], map->lod_rings[2]);
+	remesh_view(map);
+}
+
+// let the level of detail rings pulled in by `shed_meshes` out again by one chunk, once
+// chunk meshes are well under budget; the gap to the budget keeps the rings from flapping
+static void restore_lods(map_system_t* map)
+{
+	if (std::equal(map->lod_rings, map->lod_rings + map_system_t::MAX_LOD, map->lod_rings_max))
+		return;
+	const uint32_t now = SDL_GetTicks();
+	if (now - map->lod_shed_at < LOD_SHED_MS)
+		return;
+	const size_t used = map->ctx->assets.usage(asset_manager_t::CHUNK_MESHES).bytes;
+	if (used >= static_cast<size_t>(LOD_RESTORE_USAGE * map->mesh_budget))
+		return;
+	map->lod_shed_at = now;
+	for (int i = 0; i < map_system_t::MAX_LOD; i++)
+		map->lod_rings[i] = std::min(map->lod_rings[i] + 1, map->lod_rings_max[i]);
+	std::printf("[map] under mesh budget, lod_rings=%d,%d,%d\n",
+		map->lod_rings[0], map->lod_rings[1], map->lod_rings[2]);
+	remesh_view(map);
+}
+
+// camera positions older than this don't count towards its velocity
+static const uint32_t CAMERA_HISTORY_MS = 250;
+
+// queue, as low priority jobs, the chunks that would come into view where the camera
+// is headed `prefetch_ms` from now; the ones closest to the look direction go first
+static void prefetch_chunks(map_system_t* map, const Camera& cam)
+{
+	ZoneScoped;
+
+	const uint32_t now = SDL_GetTicks();
+	auto& history = map->camera_history;
+	history.push_back({ now, cam.pos });
+	while (history.size() > 2 && now - history.front().first > CAMERA_HISTORY_MS)
+		history.pop_front();
+	if (map->prefetch_ms == 0 || now == history.front().first)
+		return;
+
+	const float dt = static_cast<float>(now - history.front().first) / 1000.f;
+	const glm::vec3 velocity = (cam.pos - history.front().second) / dt;
+	const glm::ivec3 target = get_chunk_pos(cam.pos + velocity * (static_cast<float>(map->prefetch_ms) / 1000.f));
+	if (target == map->chunk_coord || target == map->prefetch_coord)
+		return;
+	map->prefetch_coord = target;
+
+	std::vector<glm::ivec3> ahead;
+	view_box_difference(target, map->chunk_coord, (int)map->view_distance, [map, &ahead](const glm::ivec3& coord) {
+		if (map->chunk_cache.find(coord) == NO_CHUNK)
+			ahead.push_back(coord);
+	});
+
+	const glm::vec3 look = cam.look();
+	const glm::vec3 center = glm::vec3(map->chunk_coord);
+	std::sort(ahead.begin(), ahead.end(), [&look, &center](const glm::ivec3& a, const glm::ivec3& b) {
+		return glm::dot(glm::normalize(glm::vec3(a) - center), look) > glm::dot(glm::normalize(glm::vec3(b) - center), look);
+	});
+
+	// keep at most one slab's worth queued, so stale predictions don't pile up
+	const size_t side = 2 * map->view_distance + 1;
+	const size_t queued = map->loader.prefetching();
+	const size_t budget = queued < side * side ? side * side - queued : 0;
+	for (size_t i = 0; i < ahead.size() && i < budget; i++) {
+		const uint32_t slot = acquire_chunk(map, ahead[i]);
+		chunk_t& ch = map->chunk_cache[slot];
+		ch.prefetched = true;
+		queue_chunk(map, ch, true);
+		map->prefetch_issued++;
 	}
 }
 
@@ -381,20 +1072,78 @@ void map_system_t::init(entity_t camera, size_t view_distance_, uint32_t seed_)
 
 	seed = seed_ == 0 ? generate_seed() : seed_;
 	HastyNoise::loadSimd("./");
-	noise = HastyNoise::CreateNoise(seed, 3);
 	view_distance = view_distance_;
+	chunks_per_frame = static_cast<size_t>(ctx->cfg.get<int>("chunks_per_frame"));
+	mesh_mode = ctx->cfg.get<int>("mesh_mode");
+	const size_t load_threads = static_cast<size_t>(ctx->cfg.get<int>("load_threads"));
+
+	// generators keep their settings as state, so each worker gets its own, set up once
+	noise.resize(load_threads);
+	for (noise_layers_t& layers : noise) {
+		layers.terrain = HastyNoise::CreateNoise(seed, 3);
+		layers.terrain->SetNoiseType(HastyNoise::NoiseType::SimplexFractal);
+		layers.terrain->SetFractalOctaves(5);
+		layers.terrain->SetFrequency(0.0025f);
+	}
+	const size_t heightmap_columns = static_cast<size_t>(ctx->cfg.get<int>("heightmap_cache"));
+	residency.set_budget(static_cast<size_t>(ctx->cfg.get<int>("chunk_cache_mb")) << 20);
+	mesh_budget = static_cast<size_t>(ctx->cfg.get<int>("mesh_budget_mb")) << 20;
+	ctx->assets.set_budget(asset_manager_t::CHUNK_MESHES, mesh_budget, [this](size_t over) {
+		shed_meshes(this, over);
+	});
+	prefetch_ms = static_cast<uint32_t>(ctx->cfg.get<int>("prefetch_ms"));
+	heightmaps.set_capacity(heightmap_columns);
+	for (int i = 0; i < MAX_LOD; i++) {
+		lod_rings[i] = ctx->cfg.get<int>("lod_rings", i + 1);
+		lod_rings_max[i] = lod_rings[i];
+	}
 
 	std::printf("[map] seed=%u\n", seed);
 	std::printf("[map] view_distance=%zu\n", view_distance);
+	std::printf("[map] load_threads=%zu chunks_per_frame=%zu\n", load_threads, chunks_per_frame);
+	std::printf("[map] heightmap_cache=%zu columns\n", heightmap_columns);
+	std::printf("[map] chunk_cache=%zu MB\n", residency.budget() >> 20);
+	std::printf("[map] mesh_budget=%zu MB\n", mesh_budget >> 20);
+	std::printf("[map] prefetch_ms=%u\n", prefetch_ms);
+	std::printf("[map] lod_rings=%d,%d,%d\n", lod_rings[0], lod_rings[1], lod_rings[2]);
+	std::printf("[map] classify kernel=%s\n", classify_kernel_name());
+
+	// chunks are only valid for the seed that generated them, so a random seed
+	// would only leave behind a directory that is never read again
+	store_mode = ctx->cfg.get<int>("chunk_store");
+	if (store_mode != STORE_OFF && seed_ == 0) {
+		std::printf("[map] chunk_store off: the seed is random\n");
+		store_mode = STORE_OFF;
+	}
+	if (store_mode != STORE_OFF) {
+		const std::string store_dir = "chunks/" + std::to_string(seed);
+		if (!store.open(store_dir))
+			store_mode = STORE_OFF;
+		else
+			std::printf("[map] chunk_store=%s (%s)\n", store_dir.c_str(), store_mode == STORE_MESHES ? "volumes+meshes" : "volumes");
+	}
+	// without a store, recycling an edited chunk would lose its edits
+	residency.pin_edited(store_mode == STORE_OFF);
+	std::printf("[map] mesh_mode=%s\n", mesh_mode == MESH_FACES ? "faces" : "boxes");
+
+	loader.start(load_threads, [this](size_t worker, const chunk_job_t& job, chunk_result_t& out) {
+		generate_chunk(this, worker, job, out);
+	});
 
 	Camera& cam = ctx->emgr.get_component<Camera>(camera);
 	chunk_coord = get_chunk_pos(cam.pos);
+	look = prioritized_look = cam.look();
+	// half-angle of a cone around the view frustum (fov is vertical), plus a chunk's worth of slack
+	const float aspect = static_cast<float>(ctx->width) / static_cast<float>(ctx->height);
+	const float half_view = std::atan(std::tan(glm::radians(cam.fov) * 0.5f) * std::sqrt(1.f + aspect * aspect));
+	cos_view = std::cos(std::min(half_view + glm::radians(10.f), glm::radians(89.f)));
 
+	// the view box is every chunk at most `view_distance` away on each axis (see `in_view`)
 	std::vector<glm::ivec3> to_load;
 	int vdist = static_cast<int>(view_distance);
-	for (int i = -vdist; i < vdist; i++) {
-		for (int j = -vdist; j < vdist; j++) {
-			for (int k = -vdist; k < vdist; k++) {
+	for (int i = -vdist; i <= vdist; i++) {
+		for (int j = -vdist; j <= vdist; j++) {
+			for (int k = -vdist; k <= vdist; k++) {
 				to_load.emplace_back(chunk_coord + glm::ivec3(i, j, k));
 			}
 		}
@@ -404,45 +1153,168 @@ void map_system_t::init(entity_t camera, size_t view_distance_, uint32_t seed_)
 
 void map_system_t::update(entity_t camera)
 {
+	finish_chunks(this);
+	restore_lods(this);
+
 	Camera& cam = ctx->emgr.get_component<Camera>(camera);
 	glm::ivec3 new_chunk_pos = get_chunk_pos(cam.pos);
-	if (chunk_coord == new_chunk_pos)
+	look = cam.look();
+	if (chunk_coord == new_chunk_pos) {
+		reprioritize_jobs(this, false);
+		prefetch_chunks(this, cam);
 		return;
+	}
 
+	// only the slab that came into view is loaded, only the one that left it is hidden
+	const glm::ivec3 old_chunk_pos = chunk_coord;
 	chunk_coord = new_chunk_pos;
+	const int vdist = static_cast<int>(view_distance);
+
 	std::vector<glm::ivec3> to_load;
-	int vdist = static_cast<int>(view_distance);
-	for (int i = -vdist; i < vdist; i++) {
-		for (int j = -vdist; j < vdist; j++) {
-			for (int k = -vdist; k < vdist; k++) {
-				to_load.emplace_back(glm::ivec3(i, j, k) + chunk_coord);
-			}
-		}
-	}
+	view_box_difference(chunk_coord, old_chunk_pos, vdist, [&to_load](const glm::ivec3& coord) {
+		to_load.push_back(coord);
+	});
 
 	{
 		ZoneScoped;
 		load_chunks(this, to_load);
 	}
 
-	// also, hide chunks that are too far away
-	for (auto& ch : chunk_cache) {
-		const chunk_t& chunk = ch.second;
-		if (!ctx->emgr.has_component<RenderModel>(chunk.entity))
+	view_box_difference(old_chunk_pos, chunk_coord, vdist, [this](const glm::ivec3& coord) {
+		const uint32_t slot = chunk_cache.find(coord);
+		if (slot != NO_CHUNK)
+			set_visible(this, chunk_cache[slot], false);
+	});
+	shed_scan = true;
+
+	update_lods(this, old_chunk_pos);
+	reprioritize_jobs(this, true);
+	prefetch_chunks(this, cam);
+}
+
+static const uint8_t ALL_MATERIALS = (1u << chunk_t::_COUNT) - 1;
+
+static void mark_dirty(map_system_t* map, uint32_t slot, uint8_t materials)
+{
+	chunk_t& ch = map->chunk_cache[slot];
+	if (!materials)
+		return;
+	if (!ch.dirty)
+		map->dirty_chunks.push_back(slot);
+	ch.dirty |= materials;
+}
+
+bool map_system_t::set_block(const glm::ivec3& pos, block_t type)
+{
+	glm::ivec3 local;
+	const glm::ivec3 coord = split_block_pos(pos, local);
+	const uint32_t slot = chunk_cache.find(coord);
+	if (slot == NO_CHUNK || !chunk_cache[slot].loaded)
+		return false;
+
+	chunk_t& ch = chunk_cache[slot];
+	const block_t old = ch.volume.get(local.x, local.y, local.z);
+	if (old == type)
+		return true;
+	ch.volume.set(local.x, local.y, local.z, type);
+	ch.edited = true;
+	if (type != chunk_t::AIR)
+		ch.bricks[local.x / 8] |= 1ull << (local.z / 8 * 8 + local.y / 8);
+	residency.set_bytes(slot, chunk_bytes(this, ch));
+
+	// a remesh in flight started from the old blocks: drop it, `flush_edits` does it all
+	if (ch.queued) {
+		ch.ticket = ++ticket;
+		ch.queued = false;
+		mark_dirty(this, slot, ALL_MATERIALS);
+	}
+
+	auto material = [](block_t t) -> uint8_t {
+		return t < chunk_t::_COUNT ? static_cast<uint8_t>(1u << t) : 0;
+	};
+	// coarse meshes depend on whole 2x2x2 cells; they are cheap enough to redo entirely
+	if (ch.lod > 0) {
+		mark_dirty(this, slot, ALL_MATERIALS);
+		return true;
+	}
+	mark_dirty(this, slot, material(old) | material(type));
+	if (mesh_mode != MESH_FACES)
+		return true;
+
+	// the faces of the blocks around it may have been hidden or exposed, possibly across a border
+	for (unsigned dir = 0; dir < 6; dir++) {
+		glm::ivec3 n_local;
+		const glm::ivec3 n_coord = split_block_pos(pos + glm::ivec3(normals[dir]), n_local);
+		const uint32_t n_slot = n_coord == coord ? slot : chunk_cache.find(n_coord);
+		if (n_slot == NO_CHUNK)
+			continue;
+		chunk_t& n = chunk_cache[n_slot];
+		// its stored meshes were culled against the old block: have them saved again without
+		if (n_slot != slot && n.loaded && store_mode == STORE_MESHES)
+			n.edited = true;
+		// its job in flight copied the old border: drop it, and remesh or regenerate against the new one
+		if (n_slot != slot && n.queued) {
+			n.ticket = ++ticket;
+			if (n.loaded) {
+				n.queued = false;
+				mark_dirty(this, n_slot, ALL_MATERIALS);
+			} else {
+				queue_chunk(this, n, n.prefetched);
+			}
 			continue;
+		}
+		if (!n.loaded || n.lod > 0)
+			continue;
+		mark_dirty(this, n_slot, material(chunk_cache[n_slot].volume.get(n_local.x, n_local.y, n_local.z)));
+	}
+	return true;
+}
+
+// remesh only the dirty materials of edited chunks, right here on the main thread so edits
+// show up the next frame. the neighbours' actual blocks are used as border, not the terrain
+void map_system_t::flush_edits()
+{
+	if (dirty_chunks.empty())
+		return;
+	ZoneScoped;
 
-		glm::ivec3 dist = glm::abs(ch.first - chunk_coord);
-		const bool visible = dist.x <= view_distance && dist.y <= view_distance && dist.z <= view_distance;
-		auto& rm = ctx->emgr.get_component<RenderModel>(chunk.entity);
-		if (rm.visible == visible)
+	static block_t blocks[CHUNK_3];
+	static chunk_border_t border;
+	for (uint32_t slot : dirty_chunks) {
+		chunk_t& ch = chunk_cache[slot];
+		uint8_t materials = ch.dirty;
+		ch.dirty = 0;
+		if (!materials || !ch.loaded)
 			continue;
 
-		RenderModel model;
-		std::memcpy(model.meshes, chunk.meshes, chunk_t::_COUNT * sizeof(asset_t));
-		model.num_meshes = chunk_t::_COUNT;
-		model.last_update = SDL_GetTicks();
-		model.visible = visible;
+		uint8_t lod, seams;
+		desired_mesh(this, ch.coord, lod, seams);
+		if (lod != ch.lod || seams != ch.seams) {
+			materials = ALL_MATERIALS;
+			ch.lod = lod;
+			ch.seams = seams;
+		}
 
-		ctx->emgr.insert_component<RenderModel>(chunk.entity, model);
+		if (!ch.volume.is_uniform())
+			ch.volume.decompress(blocks);
+		if (mesh_mode == MESH_FACES) {
+			volume_border(this, ch.coord, border);
+			open_seams(seams, border);
+		}
+		chunk_result_t result;
+		mesh_volume(this, lod, border, ch.volume, blocks, materials, result);
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			if (materials & (1u << j))
+				upload_mesh(this, ch.meshes[j], result.vertices[j], result.indices[j]);
+		}
+		residency.set_bytes(slot, chunk_bytes(this, ch));
+		submit_model(this, ch, in_view(this, ch.coord));
 	}
+	dirty_chunks.clear();
+}
+
+bool map_system_t::pick_block(const glm::vec3& origin, const glm::vec3& dir, float distance, ray_hit_t& hit) const
+{
+	const ray_t ray = { origin, dir, distance };
+	return raycast(chunk_cache, ray, hit);
 }
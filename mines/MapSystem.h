@@ -2,29 +2,40 @@
 
 #include "Entity.h"
 #include "AssetManager.h"
+#include "Chunk.h"
+#include "ChunkLoader.h"
+#include "HeightmapCache.h"
+#include "ChunkStore.h"
+#include "ChunkMap.h"
+#include "ChunkResidency.h"
+#include "Raycast.h"
 #include <cstdint>
 #include <hastyNoise.h>
 #include <unordered_map>
+#include <deque>
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/hash.hpp>
 #include <glm/vec3.hpp>
 #include <utility>
+#include <vector>
 
 struct context_t;
 
-struct chunk_t {
-	enum {
-		GRASS = 0,
-		ROCK,
-		WATER,
-		_COUNT,
-		AIR,
-	};
-	entity_t entity;
-	asset_t meshes[_COUNT];
+// noise generators of one loader worker, configured once in `init` and only read afterwards
+struct noise_layers_t {
+	std::unique_ptr<HastyNoise::NoiseSIMD> terrain;
 };
 
 struct map_system_t {
+	enum {
+		MESH_BOXES = 0,		// every greedy box with all six faces
+		MESH_FACES,			// only faces that can be seen
+	};
+	enum {
+		STORE_OFF = 0,
+		STORE_VOLUMES,		// save block volumes, remesh on load
+		STORE_MESHES,		// save the meshes too
+	};
 
 	map_system_t(context_t* ctx);
 	~map_system_t();
@@ -32,13 +43,58 @@ struct map_system_t {
 	void init(entity_t camera, size_t view_distance, uint32_t seed = 0);
 	void update(entity_t camera);
 
+	// change the block at world position `pos`; false if its chunk isn't loaded.
+	// meshes catch up on the next `flush_edits`, once per frame
+	bool set_block(const glm::ivec3& pos, block_t type);
+	void flush_edits();
+	// first solid block of the loaded chunks within `distance` along a ray, see `raycast`
+	bool pick_block(const glm::vec3& origin, const glm::vec3& dir, float distance, ray_hit_t& hit) const;
+
 	context_t* ctx;
 	size_t n_chunks;
 	size_t view_distance;
 	uint32_t seed;
-	std::unique_ptr<HastyNoise::NoiseSIMD> noise;
+	// one set per loader worker
+	std::vector<noise_layers_t> noise;
+
+	chunk_loader_t loader;
+	heightmap_cache_t heightmaps;
+	chunk_store_t store;
+	int store_mode;
+	size_t chunks_per_frame;
+	uint32_t ticket;
+	int mesh_mode;
+
+	// chunks farther than lod_rings[i] are meshed at level i + 1, see `chunk_lod`
+	static const int MAX_LOD = 3;
+	int lod_rings[MAX_LOD];
+
+	// job priorities, see `job_priority`
+	glm::vec3 look;
+	glm::vec3 prioritized_look;
+	float cos_view;
+
+	// camera motion prediction, see `prefetch_chunks`
+	uint32_t prefetch_ms;
+	glm::ivec3 prefetch_coord;
+	std::deque<std::pair<uint32_t, glm::vec3>> camera_history;
+	size_t prefetch_issued;
+	size_t prefetch_hits;
+	size_t prefetch_wasted;
 
 	glm::ivec3 chunk_coord;
-	std::unordered_map<glm::ivec3, chunk_t> chunk_cache;
-	std::vector<glm::ivec3> chunk_cache_sorted;
-};
\ No newline at end of file
+	chunk_map_t chunk_cache;
+	chunk_residency_t residency;
+	// slots with edits not meshed yet
+	std::vector<uint32_t> dirty_chunks;
+	// last RenderModel::last_update handed out, so that updates in the same tick aren't skipped
+	uint32_t model_clock;
+	// chunk mesh budget, see `shed_meshes` and `restore_lods`
+	size_t mesh_budget;
+	// lod_rings as configured; shedding pulls the rings in below these
+	int lod_rings_max[MAX_LOD];
+	uint32_t lod_shed_at;
+	// some chunks out of view may have meshes to drop; cleared by a scan that found none
+	bool shed_scan;
+	size_t meshes_dropped;
+};
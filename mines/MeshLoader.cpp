@@ -6,7 +6,7 @@
 
 int load_mesh(asset_manager_t *amgr, asset_t id, const char* path)
 {
-    Mesh* mesh_ = amgr->make<Mesh>(id);
+    Mesh* mesh_ = amgr->make<Mesh>(id, asset_manager_t::MODELS);
 
 	Assimp::Importer importer;
 	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
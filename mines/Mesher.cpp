@@ -0,0 +1,395 @@
+#include "Mesher.h"
+#include "Globals.h"
+#include "bits.h"
+#include <algorithm>
+#include <bitset>
+#include <cassert>
+#include <cstring>
+
+//static thread_local std::bitset<CHUNK_3> greedy_bitset;
+std::vector<quad_t> blocks_to_mesh_greedy(const block_t* blocks, int type)
+{
+	std::bitset<CHUNK_3> greedy_bitset;
+	greedy_bitset.reset();
+
+	auto bit_at = [&greedy_bitset](size_t x, size_t y, size_t z) {
+		return greedy_bitset[CHUNK_2 * x + CHUNK_1 * z + y];
+	};
+
+	// initialize bitset
+	for (size_t i = 0; i < CHUNK_3; i++) {
+		greedy_bitset[i] = blocks[i] == type;
+	}
+
+	///////////////////////////////////////////////////////
+	// TODO: should build quads from different corners in
+	//       the chunk and then stick with the best result.
+
+	// sweep 2D planes from y=0 to y=CHUNK_SIZE-1
+	std::vector<quad_t> quads;
+	for (unsigned y = 0; y < CHUNK_1; y++) {
+		for (unsigned z = 0; z < CHUNK_1; z++) {
+			for (unsigned x = 0; x < CHUNK_1; x++) {
+				// find a set block
+				if (!bit_at(x, y, z))
+					continue;
+				// otherwise, generate quad starting at (x, y, z)
+				// stretch the x axis
+				unsigned i;
+				for (i = x; i < CHUNK_1 && bit_at(i, y, z); i++) {}
+				unsigned w = i - x;
+				// stretch the z axis
+				unsigned j;
+				for (j = z + 1; j < CHUNK_1; j++) {
+					for (i = x; i < x + w && bit_at(i, y, j); i++) {}
+					if (i != x + w)
+						break;
+				}
+				unsigned d = j - z;
+				// stretch the y axis
+				unsigned k;
+				for (k = y + 1; k < CHUNK_1; k++) {
+					for (j = z; j < z + d; j++) {
+						for (i = x; i < x + w && bit_at(i, k, j); i++) {}
+						if (i != x + w)
+							break;
+					}
+					if (j != z + d)
+						break;
+				}
+				unsigned h = k - y;
+
+				// submit quad
+				quad_t q = { x, y, z, w, h, d };
+				quads.push_back(q);
+
+				// mark bitmask
+				for (i = x; i < x + w; i++) {
+					for (j = z; j < z + d; j++) {
+						for (k = y; k < y + h; k++) {
+							bit_at(i, k, j) = false;
+						}
+					}
+				}
+			}
+		}
+	}
+	return quads;
+}
+
+// in-place transpose of a 64x64 bit matrix: afterwards, bit i of m[j] is what was bit j of m[i]
+static void transpose64(uint64_t m[64])
+{
+	uint64_t mask = 0x00000000ffffffffull;
+	for (unsigned j = 32; j != 0; j >>= 1, mask ^= (mask << j)) {
+		for (unsigned k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+			const uint64_t t = ((m[k] >> j) ^ m[k | j]) & mask;
+			m[k] ^= t << j;
+			m[k | j] ^= t;
+		}
+	}
+}
+
+// merge the set bits of a 2D slice into rectangles: rows are `stride` apart, bits run along
+// the other axis. calls emit(first bit, bit count, first row, row count); the slice is cleared.
+template<typename F>
+static void merge_slice(uint64_t* rows, size_t stride, F emit)
+{
+	for (unsigned r = 0; r < CHUNK_1; r++) {
+		uint64_t& row = rows[r * stride];
+		while (row) {
+			const unsigned b = ctz64(row);
+			const unsigned len = ctz64(~(row >> b));
+			const uint64_t mask = low_bits64(len) << b;
+			row &= ~mask;
+			unsigned n = 1;
+			while (r + n < CHUNK_1 && (rows[(r + n) * stride] & mask) == mask) {
+				rows[(r + n) * stride] &= ~mask;
+				n++;
+			}
+			emit(b, len, r, n);
+		}
+	}
+}
+
+void mesh_columns(uint64_t* cols, std::vector<quad_t>& quads)
+{
+	static_assert(CHUNK_SIZE == 64, "column masks assume 64-block chunks");
+
+	// planes[y * CHUNK_SIZE + z] has bit x set for every solid block: the same
+	// data as `cols`, transposed so runs along x are a single ctz as well.
+	// both copies are kept in sync as boxes are carved out.
+	static thread_local uint64_t planes[CHUNK_2];
+	uint64_t any = 0;
+	for (size_t c = 0; c < CHUNK_2; c++)
+		any |= cols[c];
+	if (any == 0)
+		return;
+
+	for (size_t z = 0; z < CHUNK_1; z++) {
+		uint64_t m[64];
+		for (size_t x = 0; x < CHUNK_1; x++)
+			m[x] = cols[x * CHUNK_1 + z];
+		transpose64(m);
+		for (size_t y = 0; y < CHUNK_1; y++)
+			planes[y * CHUNK_1 + z] = m[y];
+	}
+
+	// sweep 2D planes from y=0 to y=CHUNK_SIZE-1, skipping empty ones
+	for (unsigned y = ctz64(any); y < CHUNK_1; y++) {
+		if (!((any >> y) & 1))
+			continue;
+		for (unsigned z = 0; z < CHUNK_1; z++) {
+			uint64_t& row = planes[y * CHUNK_1 + z];
+			while (row) {
+				// find a set block
+				const unsigned x = ctz64(row);
+				// stretch the x axis
+				const unsigned w = ctz64(~(row >> x));
+				const uint64_t wmask = low_bits64(w) << x;
+				// stretch the z axis
+				unsigned d = 1;
+				while (z + d < CHUNK_1 && (planes[y * CHUNK_1 + z + d] & wmask) == wmask)
+					d++;
+				// stretch the y axis: shortest run of set bits starting at y
+				unsigned h = CHUNK_SIZE - y;
+				for (unsigned i = x; i < x + w && h > 1; i++) {
+					for (unsigned j = z; j < z + d && h > 1; j++) {
+						const unsigned run = ctz64(~(cols[i * CHUNK_1 + j] >> y));
+						h = run < h ? run : h;
+					}
+				}
+
+				// submit quad
+				quad_t q = { x, y, z, w, h, d };
+				quads.push_back(q);
+
+				// carve the box out of both copies
+				const uint64_t hmask = low_bits64(h) << y;
+				for (unsigned i = x; i < x + w; i++) {
+					for (unsigned j = z; j < z + d; j++) {
+						cols[i * CHUNK_1 + j] &= ~hmask;
+					}
+				}
+				for (unsigned k = y; k < y + h; k++) {
+					for (unsigned j = z; j < z + d; j++) {
+						planes[k * CHUNK_1 + j] &= ~wmask;
+					}
+				}
+			}
+		}
+	}
+}
+
+uint32_t blocks_to_columns(const block_t* blocks, int count, uint64_t* cols, size_t size)
+{
+	assert(count <= 32);
+	assert(size <= CHUNK_1);
+
+	uint32_t present = 0;
+	for (size_t i = 0; i < size * size; i++) {
+		const block_t* column = &blocks[i * size];
+		// column index in the full-size masks
+		const size_t c = (i / size) * CHUNK_1 + i % size;
+		for (size_t y = 0; y < size; y++) {
+			const unsigned type = static_cast<unsigned>(column[y]);
+			if (type >= static_cast<unsigned>(count))
+				continue;
+			// first time we see this material: clear its masks
+			if (!(present & (1u << type))) {
+				present |= 1u << type;
+				std::memset(&cols[type * CHUNK_2], 0, CHUNK_2 * sizeof(uint64_t));
+			}
+			cols[type * CHUNK_2 + c] |= 1ull << y;
+		}
+	}
+	return present;
+}
+
+void blocks_to_mesh_materials(const block_t* blocks, int count, std::vector<quad_t>* quads, size_t size, uint32_t materials)
+{
+	static thread_local std::vector<uint64_t> cols;
+	cols.resize(count * CHUNK_2);
+
+	uint32_t todo = blocks_to_columns(blocks, count, cols.data(), size) & materials;
+	for (int j = 0; j < count; j++)
+		quads[j].clear();
+	while (todo) {
+		const unsigned type = ctz64(todo);
+		todo &= todo - 1;
+		mesh_columns(&cols[type * CHUNK_2], quads[type]);
+	}
+}
+
+// one bit per border cell, set if that neighbour block hides faces of the current material.
+// x/z borders give one mask per row along y, y borders one mask per x along z.
+static void border_masks(const block_t* slice, uint32_t hiders, int count, uint64_t out[64])
+{
+	for (size_t r = 0; r < CHUNK_1; r++) {
+		uint64_t mask = 0;
+		for (size_t i = 0; i < CHUNK_1; i++) {
+			const unsigned type = static_cast<unsigned>(slice[r * CHUNK_1 + i]);
+			const bool hides = type < static_cast<unsigned>(count) && (hiders & (1u << type));
+			mask |= static_cast<uint64_t>(hides) << i;
+		}
+		out[r] = mask;
+	}
+}
+
+static void columns_to_faces_materials(const uint64_t* cols, uint32_t present, uint32_t materials, const chunk_border_t& border, int count, uint32_t transparent, std::vector<face_t>* faces)
+{
+	static thread_local uint64_t hidden[CHUNK_2];
+	static thread_local uint64_t exposed[CHUNK_2];
+	static thread_local uint64_t planes[CHUNK_2];
+
+	// over every material, not just the present ones: the border may hold any of them
+	const uint32_t all = count >= 32 ? ~0u : (1u << count) - 1;
+	const uint32_t opaque = all & ~transparent;
+	for (int j = 0; j < count; j++)
+		faces[j].clear();
+
+	uint32_t todo = present & materials;
+	while (todo) {
+		const unsigned type = ctz64(todo);
+		todo &= todo - 1;
+
+		// blocks that hide the faces of this material
+		const uint32_t hiders = opaque | (transparent & (1u << type));
+		std::memset(hidden, 0, sizeof(hidden));
+		for (uint32_t h = hiders & present; h; h &= h - 1) {
+			const uint64_t* src = &cols[ctz64(h) * CHUNK_2];
+			for (size_t c = 0; c < CHUNK_2; c++)
+				hidden[c] |= src[c];
+		}
+		uint64_t edge[6][64];
+		for (unsigned dir = 0; dir < 6; dir++)
+			border_masks(border.blocks[dir], hiders, count, edge[dir]);
+
+		const uint64_t* solid = &cols[type * CHUNK_2];
+		std::vector<face_t>& out = faces[type];
+
+		for (unsigned dir = 0; dir < 6; dir++) {
+			// find exposed faces in column form (bit y of [x * CHUNK_SIZE + z])
+			for (size_t x = 0; x < CHUNK_1; x++) {
+				const size_t row = x * CHUNK_1;
+				switch (dir) {
+				case 0:
+					for (size_t z = 0; z < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~(x + 1 < CHUNK_1 ? hidden[row + CHUNK_1 + z] : edge[0][z]);
+					break;
+				case 3:
+					for (size_t z = 0; z < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~(x > 0 ? hidden[row - CHUNK_1 + z] : edge[3][z]);
+					break;
+				case 1:
+					for (size_t z = 0; z < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~((hidden[row + z] >> 1) | (((edge[1][x] >> z) & 1) << 63));
+					break;
+				case 4:
+					for (size_t z = 0; z < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~((hidden[row + z] << 1) | ((edge[4][x] >> z) & 1));
+					break;
+				case 2:
+					for (size_t z = 0; z + 1 < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~hidden[row + z + 1];
+					exposed[row + CHUNK_1 - 1] = solid[row + CHUNK_1 - 1] & ~edge[2][x];
+					break;
+				case 5:
+					exposed[row] = solid[row] & ~edge[5][x];
+					for (size_t z = 1; z < CHUNK_1; z++)
+						exposed[row + z] = solid[row + z] & ~hidden[row + z - 1];
+					break;
+				}
+			}
+
+			// merge them slice by slice
+			switch (dir % 3) {
+			case 0:
+				for (unsigned x = 0; x < CHUNK_1; x++) {
+					merge_slice(&exposed[x * CHUNK_1], 1, [&](unsigned y, unsigned h, unsigned z, unsigned d) {
+						out.push_back({ x, y, z, 1, h, d, dir });
+					});
+				}
+				break;
+			case 2:
+				for (unsigned z = 0; z < CHUNK_1; z++) {
+					merge_slice(&exposed[z], CHUNK_1, [&](unsigned y, unsigned h, unsigned x, unsigned w) {
+						out.push_back({ x, y, z, w, h, 1, dir });
+					});
+				}
+				break;
+			case 1:
+				for (size_t z = 0; z < CHUNK_1; z++) {
+					uint64_t m[64];
+					for (size_t x = 0; x < CHUNK_1; x++)
+						m[x] = exposed[x * CHUNK_1 + z];
+					transpose64(m);
+					for (size_t y = 0; y < CHUNK_1; y++)
+						planes[y * CHUNK_1 + z] = m[y];
+				}
+				for (unsigned y = 0; y < CHUNK_1; y++) {
+					merge_slice(&planes[y * CHUNK_1], 1, [&](unsigned x, unsigned w, unsigned z, unsigned d) {
+						out.push_back({ x, y, z, w, 1, d, dir });
+					});
+				}
+				break;
+			}
+		}
+	}
+}
+
+void blocks_to_faces_materials(const block_t* blocks, const chunk_border_t& border, int count, uint32_t transparent, std::vector<face_t>* faces, size_t size, uint32_t materials)
+{
+	static thread_local std::vector<uint64_t> cols;
+	cols.resize(count * CHUNK_2);
+
+	// a smaller cube ends next to the empty part of the masks, not at the border
+	const uint32_t present = blocks_to_columns(blocks, count, cols.data(), size);
+	columns_to_faces_materials(cols.data(), present, materials, border, count, transparent, faces);
+}
+
+void uniform_to_faces_materials(block_t type, const chunk_border_t& border, int count, uint32_t transparent, std::vector<face_t>* faces)
+{
+	static thread_local std::vector<uint64_t> cols;
+	cols.resize(count * CHUNK_2);
+
+	uint32_t present = 0;
+	if (type < count) {
+		present = 1u << type;
+		std::fill(cols.begin() + type * CHUNK_2, cols.begin() + (type + 1) * CHUNK_2, ~0ull);
+	}
+	columns_to_faces_materials(cols.data(), present, ~0u, border, count, transparent, faces);
+}
+
+void downsample_blocks(const block_t* src, size_t size, block_t* dst)
+{
+	const size_t half = size / 2;
+	for (size_t x = 0; x < half; x++) {
+		for (size_t z = 0; z < half; z++) {
+			for (size_t y = 0; y < half; y++) {
+				block_t cell[8];
+				size_t k = 0;
+				for (size_t i = 0; i < 2; i++) {
+					for (size_t j = 0; j < 2; j++) {
+						const block_t* column = &src[((2 * x + i) * size + 2 * z + j) * size + 2 * y];
+						cell[k++] = column[0];
+						cell[k++] = column[1];
+					}
+				}
+				// mode of the 8 blocks; ids are small, so just count against each other
+				block_t best = cell[0];
+				int best_count = 0;
+				for (size_t a = 0; a < 8; a++) {
+					int n = 0;
+					for (size_t b = 0; b < 8; b++)
+						n += cell[b] == cell[a];
+					if (n > best_count || (n == best_count && cell[a] < best)) {
+						best = cell[a];
+						best_count = n;
+					}
+				}
+				dst[(x * half + z) * half + y] = best;
+			}
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Globals.h"
+
+// axis-aligned box of blocks, in chunk-local block units
+struct quad_t {
+	unsigned x, y, z, w, h, d;
+};
+
+// single exposed face of a box of blocks. the box is one block thick along the
+// face normal; `dir` indexes the six axis directions: +x, +y, +z, -x, -y, -z
+struct face_t {
+	unsigned x, y, z, w, h, d;
+	unsigned dir;
+};
+
+// blocks of the six neighbouring chunks that touch this one, used to cull faces
+// on the chunk boundary. `blocks[dir]` is the neighbour slice in direction `dir`:
+//  +x/-x: [z * CHUNK_SIZE + y], +z/-z: [x * CHUNK_SIZE + y], +y/-y: [x * CHUNK_SIZE + z]
+struct chunk_border_t {
+	block_t blocks[6][CHUNK_2];
+};
+
+// reference mesher: grows boxes one bit at a time over a std::bitset.
+// `blocks_to_mesh_materials` must give the same boxes in the same order,
+// which `mines --bench-mesher` checks
+std::vector<quad_t> blocks_to_mesh_greedy(const block_t* blocks, int type);
+
+// one pass over `blocks` for all materials in [0, count): fills the column masks of
+// every material that occurs (`cols[m * CHUNK_2 + x * CHUNK_SIZE + z]`) and returns
+// a bitmask of the materials present. masks of absent materials are left untouched.
+// `blocks` is a cube of side `size` <= CHUNK_SIZE ([x * size * size + z * size + y]);
+// smaller cubes fill the low corner of the masks and leave the rest empty.
+uint32_t blocks_to_columns(const block_t* blocks, int count, uint64_t* cols, size_t size = CHUNK_SIZE);
+
+// mesh every material in [0, count) at once; `quads` must hold `count` vectors.
+// cost grows with the materials present in the chunk, not with `count`.
+// only materials in the `materials` bitmask are meshed, the other vectors are left empty.
+void blocks_to_mesh_materials(const block_t* blocks, int count, std::vector<quad_t>* quads, size_t size = CHUNK_SIZE, uint32_t materials = ~0u);
+
+// greedy-mesh a set of column masks: `cols[x * CHUNK_SIZE + z]` has bit y set
+// for every solid block. the columns are consumed (cleared) in the process.
+void mesh_columns(uint64_t* cols, std::vector<quad_t>& quads);
+
+// mesh only the faces of each material in [0, count) that are not hidden by a
+// neighbour. opaque materials are hidden by any opaque material; materials in the
+// `transparent` bitmask are also hidden by themselves (so water shows only its surface).
+// anything >= count (i.e. AIR) hides nothing. `faces` must hold `count` vectors.
+// cubes smaller than CHUNK_SIZE (see `blocks_to_columns`) ignore `border` and keep all their boundary faces.
+// as above, only materials in `materials` are meshed.
+void blocks_to_faces_materials(const block_t* blocks, const chunk_border_t& border, int count, uint32_t transparent, std::vector<face_t>* faces, size_t size = CHUNK_SIZE, uint32_t materials = ~0u);
+
+// same as `blocks_to_faces_materials` for a chunk made entirely of `type`: only
+// boundary faces not hidden by `border` are emitted
+void uniform_to_faces_materials(block_t type, const chunk_border_t& border, int count, uint32_t transparent, std::vector<face_t>* faces);
+
+// halve a cube of side `size`: each 2x2x2 cell of `src` becomes its most common block
+// in `dst` (side `size / 2`), ties going to the lowest id so solid blocks win over air
+void downsample_blocks(const block_t* src, size_t size, block_t* dst);
@@ -0,0 +1,107 @@
+#include "MesherBench.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Chunk.h"
+#include "Mesher.h"
+
+// each chunk is one of these, in turn
+enum {
+	SHAPE_TERRAIN,
+	SHAPE_CAVES,
+	SHAPE_NOISE,
+	_SHAPES,
+};
+
+static void make_chunk(size_t n, std::mt19937& rng, block_t* blocks)
+{
+	std::uniform_int_distribution<int> material(0, chunk_t::_COUNT - 1);
+	std::uniform_int_distribution<int> percent(0, 99);
+	const float phase = static_cast<float>(n) * 0.37f;
+	for (int x = 0; x < CHUNK_SIZE; x++) {
+		for (int z = 0; z < CHUNK_SIZE; z++) {
+			const int h = static_cast<int>(32.f + 14.f * std::sin(x * 0.09f + phase) * std::cos(z * 0.11f - phase));
+			for (int y = 0; y < CHUNK_SIZE; y++) {
+				block_t b = chunk_t::AIR;
+				switch (n % _SHAPES) {
+				case SHAPE_TERRAIN:
+					if (y < h - 4)
+						b = chunk_t::ROCK;
+					else if (y < h)
+						b = chunk_t::GRASS;
+					else if (y < 30)
+						b = chunk_t::WATER;
+					break;
+				case SHAPE_CAVES:
+					if (std::sin(x * 0.2f + phase) + std::sin(y * 0.25f) + std::sin(z * 0.15f - phase) < 0.8f)
+						b = y < h ? chunk_t::ROCK : chunk_t::GRASS;
+					break;
+				default:
+					if (percent(rng) < 40)
+						b = static_cast<block_t>(material(rng));
+					break;
+				}
+				blocks[x * CHUNK_2 + z * CHUNK_SIZE + y] = b;
+			}
+		}
+	}
+}
+
+static bool same_boxes(const std::vector<quad_t>& a, const std::vector<quad_t>& b)
+{
+	if (a.size() != b.size())
+		return false;
+	for (size_t i = 0; i < a.size(); i++) {
+		if (a[i].x != b[i].x || a[i].y != b[i].y || a[i].z != b[i].z
+			|| a[i].w != b[i].w || a[i].h != b[i].h || a[i].d != b[i].d)
+			return false;
+	}
+	return true;
+}
+
+int bench_mesher(size_t chunks)
+{
+	using bench_clock = std::chrono::steady_clock;
+
+	std::mt19937 rng(1234);
+	static block_t blocks[CHUNK_3];
+	std::vector<quad_t> reference[chunk_t::_COUNT];
+	std::vector<quad_t> quads[chunk_t::_COUNT];
+	double greedy_s = 0., columns_s = 0.;
+	size_t boxes = 0, bad = 0;
+
+	for (size_t n = 0; n < chunks; n++) {
+		make_chunk(n, rng, blocks);
+
+		auto t0 = bench_clock::now();
+		for (int j = 0; j < chunk_t::_COUNT; j++)
+			reference[j] = blocks_to_mesh_greedy(blocks, j);
+		greedy_s += std::chrono::duration<double>(bench_clock::now() - t0).count();
+
+		t0 = bench_clock::now();
+		blocks_to_mesh_materials(blocks, chunk_t::_COUNT, quads);
+		columns_s += std::chrono::duration<double>(bench_clock::now() - t0).count();
+
+		for (int j = 0; j < chunk_t::_COUNT; j++) {
+			boxes += quads[j].size();
+			if (!same_boxes(reference[j], quads[j])) {
+				std::printf("[bench] chunk %zu: %zu boxes of material %d, %zu in the reference\n",
+					n, quads[j].size(), j, reference[j].size());
+				bad++;
+			}
+		}
+	}
+
+	std::printf("[bench] %zu chunks, %zu boxes\n", chunks, boxes);
+	std::printf("[bench] greedy: %.2f ms/chunk, columns: %.3f ms/chunk\n",
+		greedy_s * 1e3 / chunks, columns_s * 1e3 / chunks);
+	if (bad) {
+		std::printf("[bench] %zu meshes differ from the reference!\n", bad);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
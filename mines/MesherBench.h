@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////
+// Mesher check (`mines --bench-mesher [chunks]`): meshes
+// made-up chunks (terrain, caves, noise) with the reference
+// greedy mesher and with the column mesher the game uses,
+// fails if their boxes differ and reports how long each took.
+// Returns an exit code.
+//////////////////////////////////////////////////////////////
+int bench_mesher(size_t chunks);
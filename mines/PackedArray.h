@@ -5,19 +5,37 @@
 #include <cstdio>
 #include <cstring>
 
+//////////////////////////////////////////////////////////////
+// Elements keyed by an index-plus-generation handle `E`. The
+// sparse array is indexed by `e.index()` and holds both the
+// owning handle and the element's slot in `data`, so a lookup
+// is sparse -> data; `dense` (handle per slot) is only needed
+// for iteration and removal.
+//////////////////////////////////////////////////////////////
 template<typename E>
 class packed_array_t {
 public:
+	struct sparse_t {
+		E owner;
+		size_t slot;
+	};
+
+	// empty, holds nothing until assigned a real one
+	packed_array_t()
+		: data(nullptr), dense(nullptr), sparse(nullptr), sz(0), elt_sz(0), max_elts(0)
+	{
+	}
+
 	packed_array_t(size_t elt_sz, size_t max_elts)
 		: elt_sz(elt_sz), max_elts(max_elts), sz(0)
 	{
 		data = new uint8_t[max_elts * elt_sz];
 		dense = new E[max_elts];
-		sparse = new size_t[max_elts];
+		sparse = new sparse_t[max_elts];
 
 		for (size_t i = 0; i < max_elts; i++) {
 			dense[i] = E::invalid();
-			sparse[i] = 0;
+			sparse[i] = { E::invalid(), 0 };
 		}
 	}
 
@@ -32,6 +50,17 @@ public:
 		std::swap(sparse, arr.sparse);
 	}
 
+	packed_array_t& operator=(packed_array_t&& arr) noexcept
+	{
+		std::swap(data, arr.data);
+		std::swap(dense, arr.dense);
+		std::swap(sparse, arr.sparse);
+		std::swap(sz, arr.sz);
+		std::swap(elt_sz, arr.elt_sz);
+		std::swap(max_elts, arr.max_elts);
+		return *this;
+	}
+
 	~packed_array_t()
 	{
 		if (data)
@@ -48,16 +77,17 @@ public:
 		return packed_array_t(sizeof(C), max_elts);
 	}
 
+	// false for an empty array too
 	bool has(E e) const
 	{
-		return dense[sparse[e.index()]] == e;
+		return e.index() < max_elts && sparse[e.index()].owner == e;
 	}
 
 	uint8_t* get(E e)
 	{
 		assert(e.index() < max_elts);
-		assert(dense[sparse[e.index()]] == e);
-		return &data[sparse[e.index()] * elt_sz];
+		assert(sparse[e.index()].owner == e);
+		return &data[sparse[e.index()].slot * elt_sz];
 	}
 
 	template<typename C>
@@ -67,7 +97,7 @@ public:
 		return *(C*)get(e);
 	}
 
-	void emplace_batch(E* e, uint8_t* data, size_t ct)
+	void emplace_batch(E* e, uint8_t* bytes, size_t ct)
 	{
 		// TODO
 		// assumes entities have not been registered yet!
@@ -79,22 +109,22 @@ public:
 		// link up sparse-dense
 		const size_t old_sz = sz;
 		for (size_t i = 0; i < ct; i++) {
-			sparse[e[i].index()] = sz++;
-			dense[sz] = e[i];
+			sparse[e[i].index()] = { e[i], sz };
+			dense[sz++] = e[i];
 		}
 		// copy component data
-		std::memcpy(&data[old_sz], data, ct * elt_sz);
+		std::memcpy(&data[old_sz * elt_sz], bytes, ct * elt_sz);
 	}
 
 	void emplace(E e, uint8_t* bytes)
 	{
 		assert(e.index() < max_elts);
-		if (dense[sparse[e.index()]] != e) {
+		if (sparse[e.index()].owner != e) {
 			assert(sz < max_elts);
-			sparse[e.index()] = sz++;
+			sparse[e.index()] = { e, sz++ };
 		}
 
-		dense[sparse[e.index()]] = e;
+		dense[sparse[e.index()].slot] = e;
 		uint8_t* dest = get(e);
 		std::memcpy(dest, bytes, elt_sz);
 	}
@@ -109,16 +139,19 @@ public:
 	void remove(E e)
 	{
 		assert(e.index() < max_elts);
-		if (dense[sparse[e.index()]] != e)
+		if (sparse[e.index()].owner != e)
 			return;
-		dense[sparse[e.index()]] = E::invalid();
-		if (sparse[e.index()] == --sz)
+		const size_t slot = sparse[e.index()].slot;
+		sparse[e.index()].owner = E::invalid();
+		dense[slot] = E::invalid();
+		if (slot == --sz)
 			return;
 
 		E back = dense[sz];
-		dense[sparse[e.index()]] = back;
-		std::memcpy((void*)&data[sparse[e.index()] * elt_sz], (void*)&data[sparse[back.index()] * elt_sz], elt_sz);
-		sparse[back.index()] = sparse[e.index()];
+		dense[sz] = E::invalid();
+		dense[slot] = back;
+		std::memcpy((void*)&data[slot * elt_sz], (void*)&data[sz * elt_sz], elt_sz);
+		sparse[back.index()].slot = slot;
 	}
 
 	template<typename C>
@@ -144,10 +177,16 @@ public:
 		return sz;
 	}
 
+	// 0 for an empty array
+	size_t capacity() const
+	{
+		return max_elts;
+	}
+
 	void print() {
 		std::printf("sparse: [");
 		for (size_t i = 0; i < max_elts; i++) {
-			std::printf(" %zu->%zu ", i, sparse[i]);
+			std::printf(" %zu->%zu ", i, sparse[i].slot);
 		}
 		std::printf("]\ndense:  [");
 		for (size_t i = 0; i < max_elts; i++) {
@@ -155,7 +194,7 @@ public:
 			if (dense[i] == E::invalid()) {
 				std::printf("? ");
 			} else {
-				std::printf("%zu ", dense[i].index);
+				std::printf("%u ", dense[i].index());
 			}
 		}
 		std::printf("]\n");
@@ -164,8 +203,8 @@ public:
 private:
 	uint8_t *data;
 	E* dense;
-	size_t *sparse;
+	sparse_t *sparse;
 	size_t sz;
-	const size_t elt_sz;
-	const size_t max_elts;
+	size_t elt_sz;
+	size_t max_elts;
 };
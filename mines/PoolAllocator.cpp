@@ -0,0 +1,102 @@
+#include "PoolAllocator.h"
+#include <cassert>
+#include <cstdlib>
+
+static_assert(sizeof(pool_allocator_t::header_t) % 16 == 0, "blocks must stay 16-byte aligned");
+
+static const size_t MIN_CLASS_SIZE = 64;
+
+pool_allocator_t::pool_allocator_t()
+	: idle(0), live(0)
+{
+	for (uint32_t c = 0; c < NUM_CLASSES; c++)
+		free_lists[c] = nullptr;
+}
+
+pool_allocator_t::~pool_allocator_t()
+{
+	trim();
+}
+
+size_t pool_allocator_t::trim()
+{
+	const size_t freed = idle;
+	for (uint32_t c = 0; c < NUM_CLASSES; c++) {
+		header_t* h = free_lists[c];
+		while (h) {
+			header_t* next = h->next;
+			std::free(h);
+			h = next;
+		}
+		free_lists[c] = nullptr;
+	}
+	idle = 0;
+	return freed;
+}
+
+// class c > 0 is (m + 1) << (e - 2) bytes for e >= 6, m in [4, 7]: c = (e - 6) * 4 + (m - 4) + 1
+uint32_t pool_allocator_t::class_of(size_t sz)
+{
+	if (sz <= MIN_CLASS_SIZE)
+		return 0;
+	const size_t n = sz - 1;
+	unsigned e = 0;
+	while ((n >> e) > 1)
+		e++;
+	const size_t m = n >> (e - 2);
+	const uint32_t c = static_cast<uint32_t>((e - 6) * 4 + (m - 4) + 1);
+	return c < NUM_CLASSES ? c : LARGE;
+}
+
+size_t pool_allocator_t::class_size(uint32_t size_class)
+{
+	if (size_class == 0)
+		return MIN_CLASS_SIZE;
+	const uint32_t e = (size_class - 1) / 4 + 6;
+	const uint32_t m = (size_class - 1) % 4 + 4;
+	return static_cast<size_t>(m + 1) << (e - 2);
+}
+
+uint8_t* pool_allocator_t::allocate(size_t sz, uint32_t owner)
+{
+	const uint32_t c = class_of(sz);
+	header_t* h;
+	if (c != LARGE && free_lists[c]) {
+		h = free_lists[c];
+		free_lists[c] = h->next;
+		idle -= class_size(c);
+	} else {
+		const size_t bytes = c == LARGE ? sz : class_size(c);
+		h = static_cast<header_t*>(std::malloc(sizeof(header_t) + bytes));
+		assert(h);
+	}
+	h->prev = nullptr;
+	h->next = nullptr;
+	h->size = sz;
+	h->size_class = c;
+	h->owner = owner;
+	live++;
+	return reinterpret_cast<uint8_t*>(h + 1);
+}
+
+void pool_allocator_t::free(uint8_t* ptr)
+{
+	if (ptr == nullptr)
+		return;
+	header_t* h = header(ptr);
+	live--;
+	if (h->size_class == LARGE || idle + class_size(h->size_class) > MAX_IDLE) {
+		std::free(h);
+		return;
+	}
+	h->prev = nullptr;
+	h->next = free_lists[h->size_class];
+	free_lists[h->size_class] = h;
+	idle += class_size(h->size_class);
+}
+
+size_t pool_allocator_t::capacity(uint8_t* ptr)
+{
+	const header_t* h = header(ptr);
+	return h->size_class == LARGE ? h->size : class_size(h->size_class);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//////////////////////////////////////////////////////////////
+// Size-class pool for asset chunks (mesh buffers and such).
+// Sizes are rounded up to one of four classes per power of two
+// (64, 80, 96, 112, 128, 160, ...), and freed blocks go on a
+// per-class free list instead of back to the heap, so a steady
+// stream of chunks of similar sizes stops allocating. At most
+// MAX_IDLE bytes are kept that way; past it freed blocks go
+// back to the heap, and `trim` empties the lists. Each
+// block starts with a header, so its size is known in O(1) and
+// its owner can keep it in an intrusive list. Blocks above the
+// largest class come straight from the heap. Not thread-safe.
+//////////////////////////////////////////////////////////////
+class pool_allocator_t {
+public:
+	struct header_t {
+		// owner's list of blocks while allocated, free list (next only) once freed
+		header_t* prev;
+		header_t* next;
+		// bytes asked for
+		size_t size;
+		uint32_t size_class;
+		uint32_t owner;
+	};
+
+	pool_allocator_t();
+	~pool_allocator_t();
+
+	uint8_t* allocate(size_t sz, uint32_t owner);
+	void free(uint8_t* ptr);
+	// give the blocks in free lists back to the heap; returns how many bytes that was
+	size_t trim();
+
+	static inline header_t* header(uint8_t* ptr)
+	{
+		return reinterpret_cast<header_t*>(ptr) - 1;
+	}
+	// usable bytes of a block, at least what was asked for
+	static size_t capacity(uint8_t* ptr);
+
+	// bytes sitting in free lists, and blocks handed out
+	inline size_t free_bytes() const { return idle; }
+	inline size_t live_blocks() const { return live; }
+
+private:
+	static const uint32_t LARGE = ~0u;
+	static const size_t MAX_IDLE = 4u << 20;
+	// 4 classes per power of two from 64 bytes to 16 MB
+	static const uint32_t NUM_CLASSES = 73;
+
+	static uint32_t class_of(size_t sz);
+	static size_t class_size(uint32_t size_class);
+
+	header_t* free_lists[NUM_CLASSES];
+	size_t idle;
+	size_t live;
+};
@@ -0,0 +1,108 @@
+#include "RayBench.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Raycast.h"
+
+// chunks of terrain on each side of the origin, and layers of them
+static const int AREA = 6;
+static const int LAYERS = 3;
+static const size_t NUM_RAYS = 1 << 18;
+static const int BATCHES = 8;
+
+static int terrain_height(int x, int z)
+{
+	return static_cast<int>(40.f + 12.f * std::sin(x * 0.05f) * std::cos(z * 0.07f) + 4.f * std::sin(x * 0.31f + z * 0.17f));
+}
+
+static void make_terrain(chunk_map_t& chunks)
+{
+	static block_t blocks[CHUNK_3];
+	for (int cx = -AREA; cx < AREA; cx++) {
+		for (int cz = -AREA; cz < AREA; cz++) {
+			for (int cy = 0; cy < LAYERS; cy++) {
+				// a few chunks aren't loaded, so rays have to cross the gaps
+				if ((cx * 7 + cy * 3 + cz * 5) % 11 == 0)
+					continue;
+				chunk_t ch = {};
+				ch.coord = glm::ivec3(cx, cy, cz);
+				for (int x = 0; x < CHUNK_SIZE; x++) {
+					for (int z = 0; z < CHUNK_SIZE; z++) {
+						const int h = terrain_height(cx * CHUNK_SIZE + x, cz * CHUNK_SIZE + z);
+						for (int y = 0; y < CHUNK_SIZE; y++) {
+							const int wy = cy * CHUNK_SIZE + y;
+							block_t b = chunk_t::AIR;
+							if (wy < h - 3)
+								b = chunk_t::ROCK;
+							else if (wy < h)
+								b = chunk_t::GRASS;
+							else if (wy < 36)
+								b = chunk_t::WATER;
+							blocks[x * CHUNK_2 + z * CHUNK_SIZE + y] = b;
+						}
+					}
+				}
+				ch.volume.compress(blocks);
+				ch.volume.occupancy(chunk_t::AIR, ch.bricks);
+				ch.loaded = true;
+				chunks.insert(ch);
+			}
+		}
+	}
+}
+
+int bench_rays(size_t threads)
+{
+	using bench_clock = std::chrono::steady_clock;
+
+	chunk_map_t chunks;
+	make_terrain(chunks);
+
+	// from above the terrain, mostly looking down and across; some look up and miss
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> across(-AREA * CHUNK_SIZE * 0.5f, AREA * CHUNK_SIZE * 0.5f);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	std::vector<ray_t> rays(NUM_RAYS);
+	for (ray_t& ray : rays) {
+		ray.origin = glm::vec3(across(rng), 60.f + 20.f * unit(rng), across(rng));
+		ray.dir = glm::vec3(unit(rng), unit(rng) - 0.5f, unit(rng));
+		ray.max_distance = 256.f;
+	}
+
+	std::vector<ray_hit_t> serial(NUM_RAYS);
+	auto t0 = bench_clock::now();
+	for (size_t i = 0; i < NUM_RAYS; i++)
+		raycast(chunks, rays[i], serial[i]);
+	const double serial_s = std::chrono::duration<double>(bench_clock::now() - t0).count();
+
+	raycast_pool_t pool;
+	pool.start(threads);
+	std::vector<ray_hit_t> pooled(NUM_RAYS);
+	t0 = bench_clock::now();
+	for (int b = 0; b < BATCHES; b++)
+		pool.run(chunks, rays.data(), NUM_RAYS, pooled.data());
+	const double pooled_s = std::chrono::duration<double>(bench_clock::now() - t0).count() / BATCHES;
+	pool.stop();
+
+	size_t hits = 0, bad = 0;
+	for (size_t i = 0; i < NUM_RAYS; i++) {
+		const ray_hit_t& a = serial[i];
+		const ray_hit_t& b = pooled[i];
+		hits += a.hit;
+		if (a.hit != b.hit || (a.hit && (a.block != b.block || a.normal != b.normal || a.type != b.type)))
+			bad++;
+	}
+
+	std::printf("[bench] %zu chunks, %zu rays, %zu hit\n", chunks.size(), NUM_RAYS, hits);
+	std::printf("[bench] 1 thread: %.2f ms (%.0f ns/ray)\n", serial_s * 1e3, serial_s * 1e9 / NUM_RAYS);
+	std::printf("[bench] pool of %zu + caller: %.2f ms (%.0f ns/ray)\n", threads, pooled_s * 1e3, pooled_s * 1e9 / NUM_RAYS);
+	if (bad) {
+		std::printf("[bench] %zu rays differ between the pool and a single thread!\n", bad);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////
+// Raycast benchmark (`mines --bench-rays [threads]`): casts
+// random rays through a made-up terrain of chunks (with holes
+// where chunks aren't loaded), one by one and then through a
+// raycast_pool_t, and checks that both agree. Headless, as
+// raycasts only read block volumes. Returns an exit code.
+//////////////////////////////////////////////////////////////
+int bench_rays(size_t threads);
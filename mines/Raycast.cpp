@@ -0,0 +1,203 @@
+#include "Raycast.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <glm/glm.hpp>
+#include <Tracy.hpp>
+
+static const int BRICK_SIZE = 8;
+// rays handed to a thread at a time
+static const size_t RAYS_PER_TAKE = 64;
+// batches smaller than this aren't worth waking the workers for
+static const size_t MIN_POOL_RAYS = 512;
+
+bool raycast(const chunk_map_t& chunks, const ray_t& ray, ray_hit_t& hit, uint32_t stop)
+{
+	hit.hit = false;
+	const float len = glm::length(ray.dir);
+	if (len == 0.f)
+		return false;
+	const glm::vec3 dir = ray.dir / len;
+	const glm::vec3& o = ray.origin;
+	const float inf = std::numeric_limits<float>::infinity();
+	// also catches NaN
+	const float max_distance = ray.max_distance < MAX_RAY_DISTANCE ? ray.max_distance : MAX_RAY_DISTANCE;
+
+	// voxel walk: `next` is the distance at which the ray crosses into the next block on each axis
+	glm::ivec3 voxel = glm::ivec3(glm::floor(o));
+	glm::ivec3 step;
+	glm::vec3 delta, next;
+	for (int i = 0; i < 3; i++) {
+		step[i] = dir[i] > 0.f ? 1 : (dir[i] < 0.f ? -1 : 0);
+		delta[i] = step[i] ? std::abs(1.f / dir[i]) : inf;
+	}
+	auto restart = [&]() {
+		for (int i = 0; i < 3; i++)
+			next[i] = step[i] ? (static_cast<float>(voxel[i] + (step[i] > 0)) - o[i]) / dir[i] : inf;
+	};
+	restart();
+
+	float t = 0.f;
+	int axis = -1;
+	// leave the cell [lo, lo + size) the ray is in at once, landing on the block it enters next
+	auto skip = [&](const glm::ivec3& lo, int size) {
+		float exit = inf;
+		for (int i = 0; i < 3; i++) {
+			if (!step[i])
+				continue;
+			const float bound = static_cast<float>(step[i] > 0 ? lo[i] + size : lo[i]);
+			const float e = (bound - o[i]) / dir[i];
+			if (e < exit) {
+				exit = e;
+				axis = i;
+			}
+		}
+		const glm::vec3 p = o + dir * exit;
+		for (int i = 0; i < 3; i++) {
+			if (i == axis)
+				voxel[i] = step[i] > 0 ? lo[i] + size : lo[i] - 1;
+			else
+				voxel[i] = glm::clamp(static_cast<int>(std::floor(p[i])), lo[i], lo[i] + size - 1);
+		}
+		t = std::max(t, exit);
+		restart();
+	};
+
+	glm::ivec3 coord(std::numeric_limits<int>::max());
+	const chunk_t* chunk = nullptr;
+	while (t <= max_distance) {
+		glm::ivec3 local;
+		const glm::ivec3 c = split_block_pos(voxel, local);
+		if (c != coord) {
+			coord = c;
+			const uint32_t slot = chunks.find(c);
+			chunk = slot != NO_CHUNK && chunks[slot].loaded ? &chunks[slot] : nullptr;
+		}
+
+		block_t type;
+		if (chunk == nullptr) {
+			skip(coord * CHUNK_SIZE, CHUNK_SIZE);
+			continue;
+		}
+		if (chunk->volume.is_uniform()) {
+			type = chunk->volume.uniform_value();
+			if (type >= 32 || !(stop & (1u << type))) {
+				skip(coord * CHUNK_SIZE, CHUNK_SIZE);
+				continue;
+			}
+		} else {
+			const glm::ivec3 b = local / BRICK_SIZE;
+			if (!((chunk->bricks[b.x] >> (b.z * 8 + b.y)) & 1)) {
+				skip(coord * CHUNK_SIZE + b * BRICK_SIZE, BRICK_SIZE);
+				continue;
+			}
+			type = chunk->volume.get(local.x, local.y, local.z);
+		}
+
+		if (type < 32 && (stop & (1u << type))) {
+			hit.hit = true;
+			hit.block = voxel;
+			hit.normal = glm::ivec3(0);
+			if (axis >= 0)
+				hit.normal[axis] = -step[axis];
+			hit.distance = t;
+			hit.type = type;
+			return true;
+		}
+
+		axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+		t = next[axis];
+		voxel[axis] += step[axis];
+		next[axis] += delta[axis];
+	}
+	return false;
+}
+
+raycast_pool_t::raycast_pool_t()
+	: quit(false), batch(0), busy(0), chunks(nullptr), rays(nullptr), hits(nullptr), count(0), stop_types(0), next(0)
+{
+}
+
+raycast_pool_t::~raycast_pool_t()
+{
+	stop();
+}
+
+void raycast_pool_t::start(size_t threads)
+{
+	assert(workers.empty());
+	quit = false;
+	for (size_t i = 0; i < threads; i++)
+		workers.emplace_back(&raycast_pool_t::work, this);
+}
+
+void raycast_pool_t::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quit = true;
+	}
+	wake.notify_all();
+	for (std::thread& t : workers)
+		t.join();
+	workers.clear();
+}
+
+void raycast_pool_t::run(const chunk_map_t& chunks_, const ray_t* rays_, size_t count_, ray_hit_t* hits_, uint32_t stop_)
+{
+	ZoneScoped;
+
+	bool shared;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		chunks = &chunks_;
+		rays = rays_;
+		hits = hits_;
+		count = count_;
+		stop_types = stop_;
+		next.store(0, std::memory_order_relaxed);
+		shared = !workers.empty() && count >= MIN_POOL_RAYS;
+		busy = shared ? workers.size() : 0;
+		if (shared)
+			batch++;
+	}
+	if (shared)
+		wake.notify_all();
+	take();
+
+	std::unique_lock<std::mutex> lock(mtx);
+	finished.wait(lock, [this] { return busy == 0; });
+}
+
+void raycast_pool_t::take()
+{
+	for (;;) {
+		const size_t begin = next.fetch_add(RAYS_PER_TAKE, std::memory_order_relaxed);
+		if (begin >= count)
+			return;
+		const size_t end = std::min(count, begin + RAYS_PER_TAKE);
+		for (size_t i = begin; i < end; i++)
+			raycast(*chunks, rays[i], hits[i], stop_types);
+	}
+}
+
+void raycast_pool_t::work()
+{
+	uint64_t seen = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			wake.wait(lock, [this, seen] { return quit || batch != seen; });
+			if (quit)
+				return;
+			seen = batch;
+		}
+		take();
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if (--busy == 0)
+				finished.notify_one();
+		}
+	}
+}
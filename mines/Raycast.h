@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/vec3.hpp>
+#include "ChunkMap.h"
+
+//////////////////////////////////////////////////////////////
+// Voxel raycasts over the loaded chunks (Amanatides & Woo
+// traversal). Chunks that aren't loaded or are uniformly empty,
+// and 8x8x8 bricks with nothing but AIR, are crossed in a
+// single step; only the blocks of occupied bricks are visited.
+// Only block volumes are read, never meshes, so this works
+// headless. Block (x, y, z) spans [x, x + 1) on each axis.
+//////////////////////////////////////////////////////////////
+
+struct ray_t {
+	glm::vec3 origin;
+	// need not be normalized
+	glm::vec3 dir;
+	// in blocks, at most MAX_RAY_DISTANCE
+	float max_distance;
+};
+
+struct ray_hit_t {
+	bool hit;
+	// world position of the block hit
+	glm::ivec3 block;
+	// face it was entered through; zero if the ray starts inside it
+	glm::ivec3 normal;
+	float distance;
+	block_t type;
+};
+
+// block types that stop rays by default
+inline const uint32_t RAY_SOLID = (1u << chunk_t::GRASS) | (1u << chunk_t::ROCK) | (1u << chunk_t::WATER);
+
+// rays never go farther than this, whatever their `max_distance` (which may be infinite)
+inline const float MAX_RAY_DISTANCE = 4096.f;
+
+// first block whose type is in `stop` (a bitmask of chunk_t types, never AIR) along the ray
+bool raycast(const chunk_map_t& chunks, const ray_t& ray, ray_hit_t& hit, uint32_t stop = RAY_SOLID);
+
+//////////////////////////////////////////////////////////////
+// Persistent threads for batches of raycasts, so a batch costs
+// a wake-up instead of starting threads. The calling thread
+// helps; rays are handed out in blocks from a shared counter.
+// Runs one batch at a time, from one thread.
+//////////////////////////////////////////////////////////////
+class raycast_pool_t {
+public:
+	raycast_pool_t();
+	~raycast_pool_t();
+
+	// `threads` workers besides the caller
+	void start(size_t threads);
+	void stop();
+
+	// `chunks` must not change until it returns
+	void run(const chunk_map_t& chunks, const ray_t* rays, size_t count, ray_hit_t* hits, uint32_t stop = RAY_SOLID);
+
+private:
+	void work();
+	// cast blocks of rays of the current batch until there are none left
+	void take();
+
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable wake;
+	std::condition_variable finished;
+	bool quit;
+	// batches run so far; workers wake up when it changes
+	uint64_t batch;
+	// workers still on the current batch
+	size_t busy;
+
+	// current batch, set under `mtx` before `batch` changes
+	const chunk_map_t* chunks;
+	const ray_t* rays;
+	ray_hit_t* hits;
+	size_t count;
+	uint32_t stop_types;
+	std::atomic<size_t> next;
+};
@@ -33,13 +33,14 @@ enum STATUS {
 };
 
 render_system_t::render_system_t(context_t* ctx)
-    : ctx(ctx), status(RS_DOWN), shader(0)
+    : ctx(ctx), status(RS_DOWN), shader(0), quad_ebo(0)
 {
 }
 
 static void cleanup(render_system_t *sys)
 {
     glDeleteProgram(sys->shader);
+    glDeleteBuffers(1, &sys->quad_ebo);
 
     for (auto& pair : sys->cmds) {
         for (auto& cmd : pair.second) {
@@ -186,6 +187,18 @@ int render_system_t::init()
 
     shader = load_shader("./phong.vert", "./phong.frag");
 
+    // index pattern shared by all quad meshes, same winding as the chunk faces
+    static const uint16_t quad[6] = { 0, 1, 2, 2, 3, 0 };
+    std::vector<uint16_t> quad_indices(6 * QUAD_BATCH);
+    for (size_t k = 0; k < QUAD_BATCH; k++) {
+        for (size_t j = 0; j < 6; j++)
+            quad_indices[6 * k + j] = static_cast<uint16_t>(quad[j] + 4 * k);
+    }
+    glGenBuffers(1, &quad_ebo);
+    glBindBuffer(GL_ARRAY_BUFFER, quad_ebo);
+    glBufferData(GL_ARRAY_BUFFER, quad_indices.size() * sizeof(uint16_t), quad_indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     return status;
 }
 
@@ -194,17 +207,27 @@ static void handle_update_indexedrendermesh(render_system_t* sys, render_system_
     if (cmd.last_update >= last_update)
         return;
 
-    glBindBuffer(GL_ARRAY_BUFFER, cmd.vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cmd.ebo);
-
-    // grow buffer if need be
-    if (cmd.mesh->num_indices > cmd.num_indices) {
-        glBufferData(GL_ARRAY_BUFFER, sizeof(IndexedMesh::Vertex) * cmd.mesh->num_verts, cmd.mesh->vertices, GL_STATIC_DRAW);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * cmd.mesh->num_indices, cmd.mesh->indices, GL_STATIC_DRAW);
+    const IndexedMesh* mesh = cmd.mesh;
+    const size_t vbo_size = sizeof(IndexedMesh::Vertex) * mesh->num_verts;
+    const size_t index_size = IndexedMesh::index_size(mesh->num_verts);
 
+    // grow buffers if need be
+    glBindBuffer(GL_ARRAY_BUFFER, cmd.vbo);
+    if (vbo_size > cmd.vbo_size) {
+        glBufferData(GL_ARRAY_BUFFER, vbo_size, mesh->vertices, GL_STATIC_DRAW);
+        cmd.vbo_size = vbo_size;
     } else {
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(IndexedMesh::Vertex) * cmd.mesh->num_verts, cmd.mesh->vertices);
-        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(unsigned int) * cmd.mesh->num_indices, cmd.mesh->indices);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vbo_size, mesh->vertices);
+    }
+    if (!cmd.shared_indices) {
+        const size_t ebo_size = index_size * mesh->num_indices;
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cmd.ebo);
+        if (ebo_size > cmd.ebo_size) {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, ebo_size, mesh->indices, GL_STATIC_DRAW);
+            cmd.ebo_size = ebo_size;
+        } else {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, ebo_size, mesh->indices);
+        }
     }
 
     if (unbind) {
@@ -212,33 +235,37 @@ static void handle_update_indexedrendermesh(render_system_t* sys, render_system_
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
 
-    cmd.num_indices = cmd.mesh->num_indices;
+    cmd.num_indices = mesh->num_indices;
+    cmd.index_type = index_size == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
     cmd.last_update = last_update;
 }
 
 static void handle_new_indexedrendermesh(render_system_t* sys, render_system_t::cmd_t& cmd, IndexedMesh* mesh, uint32_t last_update)
 {
-    // create buffers
-    glGenVertexArrays(1, &cmd.vao);
-    glGenBuffers(1, &cmd.vbo);
-    glGenBuffers(1, &cmd.ebo);
-
     // store command
     cmd.last_update = 0;
     cmd.num_indices = 0;
+    cmd.vbo_size = 0;
+    cmd.ebo_size = 0;
+    cmd.shared_indices = mesh->indices == nullptr;
     cmd.mesh = mesh;
 
+    // create buffers
+    glGenVertexArrays(1, &cmd.vao);
+    glGenBuffers(1, &cmd.vbo);
+    cmd.ebo = 0;
+    if (!cmd.shared_indices)
+        glGenBuffers(1, &cmd.ebo);
+
     // upload data
     glBindVertexArray(cmd.vao);
     handle_update_indexedrendermesh(sys, cmd, last_update, false);
+    if (cmd.shared_indices)
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sys->quad_ebo);
 
-    // describe vertex format
+    // describe vertex format: four bytes, read as integers and unpacked by the shader
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(IndexedMesh::Vertex), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(IndexedMesh::Vertex), (void*)offsetof(IndexedMesh::Vertex, IndexedMesh::Vertex::nx));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(IndexedMesh::Vertex), (void*)offsetof(IndexedMesh::Vertex, IndexedMesh::Vertex::r));
+    glVertexAttribIPointer(0, 4, GL_UNSIGNED_BYTE, sizeof(IndexedMesh::Vertex), (void*)0);
 
     // unbind buffers
     glBindVertexArray(0);
@@ -377,7 +404,15 @@ void render_system_t::render(entity_t camera)
             auto& cmd = std::get<1>(tup);
             glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(std::get<2>(tup)));
             glBindVertexArray(cmd.vao);
-            glDrawElements(GL_TRIANGLES, cmd.num_indices, GL_UNSIGNED_INT, (void*)0);
+            if (cmd.shared_indices) {
+                // the shared pattern covers QUAD_BATCH quads, longer meshes take several draws
+                for (size_t first = 0; first < cmd.num_indices; first += 6 * QUAD_BATCH) {
+                    const size_t count = std::min<size_t>(cmd.num_indices - first, 6 * QUAD_BATCH);
+                    glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)count, GL_UNSIGNED_SHORT, (void*)0, (GLint)(first / 6 * 4));
+                }
+            } else {
+                glDrawElements(GL_TRIANGLES, cmd.num_indices, cmd.index_type, (void*)0);
+            }
             glBindVertexArray(0);
         }
     }
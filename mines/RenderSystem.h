@@ -17,10 +17,17 @@ struct IndexedMesh;
 struct render_system_t {
 	struct cmd_t {
 		GLuint vao, vbo, ebo;
+		// buffer sizes in bytes, so updates only reallocate when they grow
+		size_t vbo_size, ebo_size;
 		size_t num_indices;
+		GLenum index_type;
+		// drawn with `quad_ebo` instead of an index buffer of its own
+		bool shared_indices;
 		uint32_t last_update;
 		IndexedMesh* mesh;
 	};
+	// quads covered by `quad_ebo` (the most 16-bit indices can address)
+	enum { QUAD_BATCH = 16384 };
 
 	render_system_t(context_t* ctx);
 
@@ -32,4 +39,5 @@ struct render_system_t {
 	int status;
 	context_t* ctx;
 	GLuint shader;
+	GLuint quad_ebo;
 };
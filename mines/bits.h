@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit; 64 if x == 0
+inline unsigned ctz64(uint64_t x)
+{
+	if (x == 0)
+		return 64;
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward64(&idx, x);
+	return static_cast<unsigned>(idx);
+#else
+	return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+// mask with the `n` lowest bits set, n in [0, 64]
+inline uint64_t low_bits64(unsigned n)
+{
+	return n >= 64 ? ~0ull : (1ull << n) - 1;
+}
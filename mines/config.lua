@@ -5,4 +5,15 @@ multisample = 2
 view_distance = 5
 seed = 0
 cam_pos = { 1.0, 30.0, 1.0 }
-fov = 45.0
\ No newline at end of file
+fov = 45.0
+load_threads = 4
+chunks_per_frame = 8
+mesh_mode = 1 -- 0: whole boxes, 1: visible faces only
+heightmap_cache = 400 -- chunk columns of terrain kept around
+chunk_store = 2 -- 0: off, 1: save block volumes, 2: save meshes too (only with a fixed seed)
+chunk_cache_mb = 512 -- memory kept for chunks before old ones get recycled
+mesh_budget_mb = 256 -- chunk mesh memory; past it meshes out of view are dropped, then detail is lowered (0: off)
+prefetch_ms = 1000 -- load chunks where the camera will be this far ahead (0: off)
+pick_distance = 16.0 -- farthest block the mouse can dig out or build on, in blocks
+
+lod_rings = { 2, 3, 4 } -- chunks farther than these get 2x, 4x and 8x coarser meshes (keep under view_distance)
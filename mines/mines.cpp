@@ -1,5 +1,6 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <array>
 
@@ -9,6 +10,9 @@
 #include "CameraSystem.h"
 #include "MapSystem.h"
 #include "utils.h"
+#include "AssetBench.h"
+#include "RayBench.h"
+#include "MesherBench.h"
 
 #include "Position.h"
 #include "Mesh.h"
@@ -16,6 +20,13 @@
 
 int main(int argc, char **argv)
 {
+    if (argc > 1 && std::strcmp(argv[1], "--bench-assets") == 0)
+        return bench_assets(argc > 2 ? std::atoi(argv[2]) : 4);
+    if (argc > 1 && std::strcmp(argv[1], "--bench-rays") == 0)
+        return bench_rays(argc > 2 ? std::atoi(argv[2]) : 4);
+    if (argc > 1 && std::strcmp(argv[1], "--bench-mesher") == 0)
+        return bench_mesher(argc > 2 ? std::atoi(argv[2]) : 30);
+
     bool quit = false;
 
     context_t ctx;
@@ -50,6 +61,7 @@ int main(int argc, char **argv)
     //  (because it needs the camera)
     ctx.emgr.materialize();
     map_sys.init(camera, ctx.cfg.get<int>("view_distance"), ctx.cfg.get<int>("seed"));
+    const float pick_distance = ctx.cfg.get<float>("pick_distance");
 
     uint32_t prev = SDL_GetTicks();
     uint32_t delta;
@@ -67,6 +79,24 @@ int main(int argc, char **argv)
         map_sys.update(camera);
         if (input_sys.update() != 0)
             break;
+        // block picking, at the middle of the screen: left click digs, right click
+        // puts rock against the face that was hit
+        const bool dig = input_sys.clicked(SDL_BUTTON_LEFT);
+        const bool place = input_sys.clicked(SDL_BUTTON_RIGHT);
+        if (dig || place) {
+            const Camera& cam = ctx.emgr.get_component<Camera>(camera);
+            ray_hit_t hit;
+            if (map_sys.pick_block(cam.pos, cam.look(), pick_distance, hit)) {
+                if (dig)
+                    map_sys.set_block(hit.block, chunk_t::AIR);
+                else if (hit.normal != glm::ivec3(0))
+                    map_sys.set_block(hit.block + hit.normal, chunk_t::ROCK);
+            }
+        }
+        // block edits made this frame
+        map_sys.flush_edits();
+        // may drop chunk meshes, so before the renderer reads them
+        ctx.assets.check_budgets();
         render_sys.render(camera);
     }
 
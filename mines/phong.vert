@@ -1,8 +1,8 @@
 #version 330 core
 
-layout(location=0) in vec3 vpos;
-layout(location=1) in vec3 vnormal;
-layout(location=2) in vec3 color;
+// packed chunk vertex (see IndexedMesh::Vertex): x, y, z in blocks,
+// then the normal in bits 0-2 and the block type in bits 3-7
+layout(location=0) in uvec4 vdata;
 
 out vec3 normal;
 out vec3 fragpos;
@@ -12,9 +12,21 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// same order as `normals` in MapSystem.cpp
+const vec3 normals[6] = vec3[6](
+	vec3(1.0, 0.0, 0.0), vec3(0.0, 1.0, 0.0), vec3(0.0, 0.0, 1.0),
+	vec3(-1.0, 0.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 0.0, -1.0)
+);
+// colour of each chunk_t block type: grass, rock, water
+const vec3 palette[3] = vec3[3](
+	vec3(0.45, 0.74, 0.45), vec3(0.4, 0.4, 0.4), vec3(0.69, 0.8, 0.95)
+);
+
 void main() {
+	vec3 vpos = vec3(vdata.xyz);
+	int type = int(vdata.w >> 3u);
 	gl_Position = projection * view * model * vec4(vpos, 1.0);
 	fragpos = vec3(model * vec4(vpos, 1.0));
-	normal = vnormal;
-	objectColor = color;
+	normal = normals[int(vdata.w & 7u)];
+	objectColor = type < 3 ? palette[type] : vec3(1.0, 0.0, 0.0);
 }
\ No newline at end of file